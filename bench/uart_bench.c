@@ -0,0 +1,325 @@
+/*
+  UART throughput and latency benchmark
+
+  Measures the throughput (bytes/s) and the CPU cost per byte (cycles spent
+  inside the calls) of uart_send, uart_receive, uart_send_byte, printf
+  through the device write path and bsp_uart_printf (straight into the TX
+  ring), on UART2, for several burst lengths. The
+  buffer sizes are fixed at build time (UART2_TX_BUFFER_SIZE and
+  UART2_RX_BUFFER_SIZE).
+
+  The report is printed as CSV on the standard output, one row per benchmark
+  and burst length:
+    platform,bench,tx_buffer,rx_buffer,burst,bytes,cycles,call_cycles,
+    bytes_per_s,call_cycles_per_byte,errors
+  printf and bsp_printf wait for room for a whole burst before each call, so
+  bursts longer than the TX ring cannot be measured. Those combinations are
+  skipped and have no row.
+
+  On the board, the time comes from the TMR cycle counter (bsp_cycles) and the
+  report goes to UART1. The receive benchmark needs UART2 TX (GPIO 18) wired
+  to UART2 RX (GPIO 19).
+  On the host (BENCH_HOST), the BSP runs on the peripheral simulator with
+  UART2 in loopback, and the time is the simulated one, so the call cost only
+  accounts for the peripheral accesses.
+*/
+
+#ifdef BENCH_HOST
+// fopencookie
+#define _GNU_SOURCE
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+// BSP headers
+#include "system.h"
+
+#ifdef BENCH_HOST
+#include "sim.h"
+#define BENCH_PLATFORM "host"
+#define BENCH_EOL "\n"
+#else
+#define BENCH_PLATFORM "target"
+#define BENCH_EOL "\r\n"
+#endif
+
+// Bytes transferred by each benchmark
+#ifndef BENCH_BYTES
+#define BENCH_BYTES 4096
+#endif
+
+// Longest burst
+#define BENCH_MAX_BURST 256
+
+// Giving up on a transfer after this time without progress (us)
+#define BENCH_TIMEOUT_US 100000
+
+// UART under test
+#define BENCH_UART uart_2
+
+// Time to empty the TX FIFO once the ring is empty (us)
+#define BENCH_FIFO_DRAIN_US (32 * 10 * 1000000 / UART2_BAUDRATE + 1)
+
+static const uint32_t bursts[] = {1, 16, 64, BENCH_MAX_BURST};
+
+// Source data: data[i] == i % 256, so any slice continues the pattern
+static char data[2 * BENCH_MAX_BURST];
+static char rx_buf[BENCH_MAX_BURST];
+
+typedef struct {
+    const char *name;
+    uint32_t burst;
+    uint32_t bytes;
+    uint64_t cycles;
+    uint64_t call_cycles;
+    uint32_t errors;
+    uint32_t skipped;
+} bench_result_t;
+
+// Free space in the TX ring
+static uint32_t tx_free(void) {
+    circular_buffer_span_t spans[2];
+    return uart_tx_reserve(BENCH_UART, spans);
+}
+
+// Waits until everything queued has left the UART
+static void wait_tx_drained(void) {
+    while (tx_free() < UART2_TX_BUFFER_SIZE)
+        crm_wait_for_interrupt();
+    bsp_sleep_us(BENCH_FIFO_DRAIN_US);
+}
+
+// Discards whatever is left in the RX path
+static void flush_rx(void) {
+    while (uart_read_timeout(BENCH_UART, rx_buf, sizeof(rx_buf), BENCH_FIFO_DRAIN_US) > 0)
+        ;
+}
+
+static void report(const bench_result_t *r) {
+    uint32_t cost = r->bytes ? (uint32_t) (r->call_cycles * 100 / r->bytes) : 0;
+
+    printf("%s,%s,%u,%u,%lu,%lu,%lu,%lu,%lu,%lu.%02lu,%lu" BENCH_EOL, BENCH_PLATFORM, r->name,
+           UART2_TX_BUFFER_SIZE, UART2_RX_BUFFER_SIZE,
+           (unsigned long) r->burst, (unsigned long) r->bytes,
+           (unsigned long) r->cycles, (unsigned long) r->call_cycles,
+           (unsigned long) (r->cycles ? (uint64_t) r->bytes * CPU_FREQ / r->cycles : 0),
+           (unsigned long) (cost / 100), (unsigned long) (cost % 100),
+           (unsigned long) r->errors);
+}
+
+// uart_send in bursts, idling when the ring is full
+static void bench_send(bench_result_t *r) {
+    uint32_t sent = 0, len;
+    uint64_t start, t0;
+    ssize_t n;
+
+    start = bsp_cycles();
+    while (sent < BENCH_BYTES) {
+        len = BENCH_BYTES - sent < r->burst ? BENCH_BYTES - sent : r->burst;
+        t0 = bsp_cycles();
+        n = uart_send(BENCH_UART, data + sent % 256, len);
+        r->call_cycles += bsp_cycles() - t0;
+        if (n > 0)
+            sent += n;
+        if (n < (ssize_t) len)
+            crm_wait_for_interrupt();
+    }
+    wait_tx_drained();
+    r->cycles = bsp_cycles() - start;
+    r->bytes = sent;
+}
+
+// uart_send_byte, called only when there is room so that it never blocks
+static void bench_send_byte(bench_result_t *r) {
+    uint32_t sent = 0, len, i;
+    uint64_t start, t0;
+
+    start = bsp_cycles();
+    while (sent < BENCH_BYTES) {
+        len = BENCH_BYTES - sent < r->burst ? BENCH_BYTES - sent : r->burst;
+        if (len > UART2_TX_BUFFER_SIZE)
+            len = UART2_TX_BUFFER_SIZE;
+        while (tx_free() < len)
+            crm_wait_for_interrupt();
+        t0 = bsp_cycles();
+        for (i = 0; i < len; i++, sent++)
+            uart_send_byte(BENCH_UART, data[sent % 256]);
+        r->call_cycles += bsp_cycles() - t0;
+    }
+    wait_tx_drained();
+    r->cycles = bsp_cycles() - start;
+    r->bytes = sent;
+}
+
+// uart_receive in bursts while the same UART sends the pattern back to itself
+static void bench_receive(bench_result_t *r) {
+    uint32_t sent = 0, received = 0, len, i;
+    uint64_t start, t0, last;
+    ssize_t n;
+
+    flush_rx();
+    start = last = bsp_cycles();
+    while (received < BENCH_BYTES) {
+        if (sent < BENCH_BYTES) {
+            n = uart_send(BENCH_UART, data + sent % 256,
+                          BENCH_BYTES - sent < BENCH_MAX_BURST ? BENCH_BYTES - sent : BENCH_MAX_BURST);
+            if (n > 0)
+                sent += n;
+        }
+
+        len = BENCH_BYTES - received < r->burst ? BENCH_BYTES - received : r->burst;
+        t0 = bsp_cycles();
+        n = uart_receive(BENCH_UART, rx_buf, len);
+        r->call_cycles += bsp_cycles() - t0;
+
+        if (n > 0) {
+            for (i = 0; i < (uint32_t) n; i++)
+                if (rx_buf[i] != data[(received + i) % 256])
+                    r->errors++;
+            received += n;
+            last = bsp_cycles();
+        } else if (bsp_cycles() - last > (uint64_t) BENCH_TIMEOUT_US * (CPU_FREQ / 1000000)) {
+            break;
+        } else {
+            crm_wait_for_interrupt();
+        }
+    }
+    r->cycles = bsp_cycles() - start;
+    r->bytes = received;
+    r->errors += BENCH_BYTES - received;
+}
+
+#ifdef BENCH_HOST
+// On the host, stdio reaches the BSP device write function through a cookie
+static ssize_t bench_cookie_write(void *cookie, const char *buf, size_t size) {
+    bsp_dev_t *dev = cookie;
+    return dev->write(dev->id, (char *) buf, size);
+}
+
+static FILE *open_uart(void) {
+    cookie_io_functions_t io = {NULL, bench_cookie_write, NULL, NULL};
+    return fopencookie(find_dev(UART2_NAME), "w", io);
+}
+#else
+static FILE *open_uart(void) {
+    return fopen(UART2_NAME, "w");
+}
+#endif
+
+// One printf per burst producing exactly burst bytes, waiting for room first
+// (so that the time blocked in write does not count as call cost)
+static void bench_printf(bench_result_t *r) {
+    static char line_buf[BENCH_MAX_BURST + 1];
+    uint32_t sent = 0, i = 0;
+    uint64_t start, t0;
+    FILE *f;
+
+    // Bursts longer than the ring would never find room
+    if (r->burst > UART2_TX_BUFFER_SIZE) {
+        r->skipped = 1;
+        return;
+    }
+    f = open_uart();
+    if (f == NULL) {
+        r->errors = BENCH_BYTES;
+        return;
+    }
+    setvbuf(f, line_buf, _IOLBF, sizeof(line_buf));
+
+    start = bsp_cycles();
+    while (sent < BENCH_BYTES) {
+        while (tx_free() < r->burst)
+            crm_wait_for_interrupt();
+        t0 = bsp_cycles();
+        if (r->burst > 1)
+            fprintf(f, "%0*lu\n", (int) r->burst - 1, (unsigned long) i++);
+        else
+            fputc('\n', f);
+        r->call_cycles += bsp_cycles() - t0;
+        sent += r->burst;
+    }
+    wait_tx_drained();
+    r->cycles = bsp_cycles() - start;
+    r->bytes = sent;
+    fclose(f);
+}
+
+// Same output as bench_printf, formatted by the BSP straight into the TX ring
+static void bench_bsp_printf(bench_result_t *r) {
+    uint32_t sent = 0, i = 0;
+    uint64_t start, t0;
+
+    if (r->burst > UART2_TX_BUFFER_SIZE) {
+        r->skipped = 1;
+        return;
+    }
+
+    start = bsp_cycles();
+    while (sent < BENCH_BYTES) {
+        while (tx_free() < r->burst)
+            crm_wait_for_interrupt();
+        t0 = bsp_cycles();
+        if (r->burst > 1)
+            bsp_uart_printf(BENCH_UART, "%0*lu\n", (int) r->burst - 1, (unsigned long) i++);
+        else
+            bsp_uart_printf(BENCH_UART, "\n");
+        r->call_cycles += bsp_cycles() - t0;
+        sent += r->burst;
+    }
+    wait_tx_drained();
+    r->cycles = bsp_cycles() - start;
+    r->bytes = sent;
+}
+
+typedef struct {
+    const char *name;
+    void (*run)(bench_result_t *r);
+} bench_t;
+
+static const bench_t benches[] = {
+    {"uart_send", bench_send},
+    {"uart_send_byte", bench_send_byte},
+    {"uart_receive", bench_receive},
+    {"printf", bench_printf},
+    {"bsp_printf", bench_bsp_printf},
+};
+
+int main(void) {
+    bench_result_t r;
+    uint32_t b, i;
+
+#ifdef BENCH_HOST
+    if (sim_init() < 0) {
+        perror("sim_init");
+        return 1;
+    }
+    sim_bsp_init();
+    sim_uart_set_loopback(BENCH_UART, 1);
+#endif
+
+    for (i = 0; i < sizeof(data); i++)
+        data[i] = i;
+
+    printf("platform,bench,tx_buffer,rx_buffer,burst,bytes,cycles,call_cycles,"
+           "bytes_per_s,call_cycles_per_byte,errors" BENCH_EOL);
+
+    for (b = 0; b < sizeof(benches) / sizeof(benches[0]); b++) {
+        for (i = 0; i < sizeof(bursts) / sizeof(bursts[0]); i++) {
+            memset(&r, 0, sizeof(r));
+            r.name = benches[b].name;
+            r.burst = bursts[i];
+            flush_rx();
+            benches[b].run(&r);
+            if (!r.skipped)
+                report(&r);
+        }
+    }
+
+#ifdef BENCH_HOST
+    return 0;
+#else
+    while (1)
+        bsp_sleep_us(1000000);
+#endif
+}
@@ -0,0 +1,93 @@
+/*
+ * Sistemas operativos empotrados
+ * Driver para el módulo de control de reloj y reset (CRM) del MC1322x
+ */
+
+#include "system.h"
+
+/*****************************************************************************/
+
+/**
+ * Acceso estructurado a los registros del CRM del MC1322x
+ */
+typedef struct
+{
+	/* Control del sistema */
+	uint32_t SYS_CNTL;
+
+	/* Control de las fuentes de despertar */
+	uint32_t WU_CNTL;
+
+	/* Control de los modos de bajo consumo */
+	uint32_t SLEEP_CNTL;
+
+	/* Control del robo de ciclos (bus stealing) a la CPU */
+	union
+	{
+		struct
+		{
+			uint32_t BS_EN			: 1;
+			uint32_t WAIT4IRQ		: 1;
+			uint32_t BS_MAN_EN		: 1;
+			uint32_t				: 5;
+			uint32_t ARM_OFF_TIME	: 6;
+		};
+		uint32_t BS_CNTL;
+	};
+
+	/* Control del watchdog */
+	uint32_t COP_CNTL;
+	uint32_t COP_SERVICE;
+
+	/* Estado de los eventos de despertar. Se limpian escribiendo un uno */
+	uint32_t STATUS;
+} crm_regs_t;
+
+static volatile crm_regs_t* const crm_regs = CRM_BASE;
+
+/*****************************************************************************/
+
+/**
+ * Manejador de interrupciones del CRM
+ * Reconoce los eventos de despertar pendientes
+ */
+static void crm_isr (void)
+{
+	crm_regs->STATUS = crm_regs->STATUS;
+}
+
+/*****************************************************************************/
+
+/**
+ * Inicializa el CRM
+ * Instala el manejador de las interrupciones del CRM, que reconoce los eventos
+ * de despertar pendientes
+ */
+void crm_init (void)
+{
+	crm_regs->BS_CNTL = 0;
+
+	itc_set_priority (itc_src_crm, itc_priority_normal);
+	itc_set_handler (itc_src_crm, crm_isr);
+	itc_enable_interrupt (itc_src_crm);
+}
+
+/*****************************************************************************/
+
+/**
+ * Detiene el reloj de la CPU hasta la siguiente interrupción (IRQ o FIQ)
+ * Se usa para esperar sin consumir energía en lugar de hacer encuesta sobre
+ * los registros de los periféricos. Como el tick del sistema genera una
+ * interrupción periódica, la espera nunca es más larga que un tick
+ */
+inline void crm_wait_for_interrupt (void)
+{
+	/* El CRM para el reloj del ARM hasta que llega una petición de interrupción */
+	crm_regs->BS_CNTL = (1 << 1) |		/* WAIT4IRQ = 1 */
+						(1 << 0);		/* BS_EN = 1 */
+
+	/* Al despertar dejamos el reloj de la CPU libre de nuevo */
+	crm_regs->BS_CNTL = 0;
+}
+
+/*****************************************************************************/
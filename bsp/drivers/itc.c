@@ -150,7 +150,7 @@ inline void itc_set_handler (itc_src_t src, itc_handler_t handler)
 inline void itc_set_priority (itc_src_t src, itc_priority_t priority)
 {
         if (priority)
-        	itc_regs->INTTYPE = (1 << src);
+        	itc_regs->INTTYPE |= (1 << src);
         else
                 itc_regs->INTTYPE &= ~ (1 << src);
 }
@@ -208,7 +208,36 @@ inline void itc_unforce_interrupt (itc_src_t src)
  */
 void itc_service_normal_interrupt ()
 {
+	bsp_isr_reent_enter ();
 	itc_handlers[itc_regs->NIVECTOR]();		/* Servimos la IRQ */
+	bsp_isr_reent_exit ();
+}
+
+/*****************************************************************************/
+
+/**
+ * Da servicio a la interrupción normal pendiente de más prioridad permitiendo
+ * el anidamiento. Se llama desde excep_nested_irq_handler en modo System.
+ * Eleva NIMASK al nivel de la fuente servida, de forma que ella y las de menor
+ * prioridad quedan enmascaradas, y vuelve a habilitar las IRQ en la CPU para
+ * que las fuentes de más prioridad puedan expulsar al manejador. Al terminar
+ * deshabilita las IRQ y restaura el nivel de NIMASK anterior
+ */
+void itc_service_nested_interrupt ()
+{
+	uint32_t src = itc_regs->NIVECTOR;
+	uint32_t nimask = itc_regs->NIMASK;
+
+	/* Enmascaramos la fuente servida y las de menor prioridad */
+	itc_regs->NIMASK = src;
+	bsp_isr_reent_enter ();
+	excep_restore_irq (0);
+
+	itc_handlers[src]();		/* Servimos la IRQ */
+
+	excep_disable_irq ();
+	bsp_isr_reent_exit ();
+	itc_regs->NIMASK = nimask;
 }
 
 /*****************************************************************************/
@@ -0,0 +1,361 @@
+/*
+ * Sistemas operativos empotrados
+ * Driver para los temporizadores del MC1322x
+ */
+
+#include <errno.h>
+#include <string.h>
+#include "system.h"
+
+/*****************************************************************************/
+
+/**
+ * Acceso estructurado a los registros de un canal del TMR del MC1322x
+ * Todos los registros son de 16 bits y sólo admiten accesos de 16 bits
+ */
+typedef struct
+{
+	/* Registros de comparación */
+	uint16_t COMP1;
+	uint16_t COMP2;
+
+	/* Registro de captura */
+	uint16_t CAPT;
+
+	/* Valor de recarga del contador */
+	uint16_t LOAD;
+
+	/* Copia del contador */
+	uint16_t HOLD;
+
+	/* Contador */
+	uint16_t CNTR;
+
+	/* Registro de control */
+	union
+	{
+		struct
+		{
+			uint16_t OM			: 3;
+			uint16_t Co_INIT	: 1;
+			uint16_t DIR		: 1;
+			uint16_t LENGTH		: 1;
+			uint16_t ONCE		: 1;
+			uint16_t SCS		: 2;
+			uint16_t PCS		: 4;
+			uint16_t CM			: 3;
+		};
+		uint16_t CTRL;
+	};
+
+	/* Registro de estado y control */
+	union
+	{
+		struct
+		{
+			uint16_t OEN		: 1;
+			uint16_t OPS		: 1;
+			uint16_t FORCE		: 1;
+			uint16_t VAL		: 1;
+			uint16_t EEOF		: 1;
+			uint16_t MSTR		: 1;
+			uint16_t CAPTURE_MODE	: 2;
+			uint16_t INPUT		: 1;
+			uint16_t IPS		: 1;
+			uint16_t IEFIE		: 1;
+			uint16_t IEF		: 1;
+			uint16_t TOFIE		: 1;
+			uint16_t TOF		: 1;
+			uint16_t TCFIE		: 1;
+			uint16_t TCF		: 1;
+		};
+		uint16_t SCTRL;
+	};
+
+	/* Valores de precarga de los registros de comparación */
+	uint16_t CMPLD1;
+	uint16_t CMPLD2;
+
+	/* Registro de estado y control de los comparadores */
+	union
+	{
+		struct
+		{
+			uint16_t CL1		: 2;
+			uint16_t CL2		: 2;
+			uint16_t TCF1		: 1;
+			uint16_t TCF2		: 1;
+			uint16_t TCF1EN		: 1;
+			uint16_t TCF2EN		: 1;
+			uint16_t			: 8;
+		};
+		uint16_t CSCTRL;
+	};
+
+	/* Reservado */
+	uint16_t reserved[4];
+
+	/* Habilitación de los canales (sólo existe en el canal 0) */
+	uint16_t ENBL;
+} tmr_regs_t;
+
+static volatile tmr_regs_t* const tmr_regs = TMR_BASE;
+
+/*****************************************************************************/
+
+/**
+ * Configuración del contador
+ * Fuente primaria: reloj del bus dividido por 8 (PCS = 1011)
+ */
+#define TMR_PCS_DIV_8			0xB
+#define TMR_CM_RISING_EDGES		0x1
+#define TMR_COUNTS_PER_US		(CPU_FREQ / 8 / 1000000)
+
+/*****************************************************************************/
+
+/**
+ * Estado del reloj del sistema
+ * tmr_ticks se actualiza el último en la isr, de forma que las lecturas en
+ * modo usuario pueden detectar si la isr se ha ejecutado en medio y repetirse
+ */
+static volatile uint32_t tmr_ticks = 0;			/* Ticks transcurridos */
+static volatile uint64_t tmr_us = 0;			/* Microsegundos en el último tick */
+static volatile uint16_t tmr_last_comp = 0;		/* Valor del contador en el último tick */
+
+static uint32_t tmr_tick_us;					/* Periodo del tick en microsegundos */
+static uint32_t tmr_tick_counts;				/* Periodo del tick en cuentas */
+
+/**
+ * Funciones que se llaman en cada tick
+ */
+static tmr_tick_hook_t tmr_tick_hooks[TMR_MAX_TICK_HOOKS];
+static volatile uint32_t tmr_num_tick_hooks = 0;
+
+static void tmr_isr (void);
+
+/*****************************************************************************/
+
+/**
+ * Lectura del dispositivo del temporizador
+ * Retorna el tiempo transcurrido en microsegundos como un uint64_t
+ * @param id	Identificador del dispositivo
+ * @param buf	Búfer para almacenar el tiempo
+ * @param count	Tamaño del búfer. Debe ser de al menos sizeof(uint64_t) bytes
+ * @return	El número de bytes leídos en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+static ssize_t tmr_read (uint32_t id, char *buf, size_t count)
+{
+	uint64_t now;
+
+	if (buf == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+	if (count < sizeof (now)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	now = bsp_time_us ();
+	memcpy (buf, &now, sizeof (now));
+
+	return sizeof (now);
+}
+
+/*****************************************************************************/
+
+/**
+ * Inicializa el temporizador del sistema
+ * Configura el canal 0 del bloque TMR como un contador libre de 16 bits que
+ * cuenta ciclos del reloj del bus divididos por 8, y programa su comparador para
+ * generar una interrupción periódica (tick). A partir de ambos se mantiene un
+ * reloj monotónico con resolución de microsegundos
+ * @param hz	Frecuencia del tick en Hz. El periodo debe ser un número entero
+ * 				de microsegundos y caber en el contador de 16 bits
+ * @param name	Nombre del dispositivo
+ * @return		Cero en caso de éxito o -1 en caso de error.
+ * 				La condición de error se indica en la variable global errno
+ */
+int32_t tmr_init (uint32_t hz, const char *name)
+{
+	if (name == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+
+	if (hz == 0 || 1000000 % hz != 0 ||
+		(1000000 / hz) * TMR_COUNTS_PER_US > 0xFFFF) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	tmr_tick_us = 1000000 / hz;
+	tmr_tick_counts = tmr_tick_us * TMR_COUNTS_PER_US;
+
+	/* Deshabilitamos el canal mientras lo configuramos */
+	tmr_regs->ENBL &= ~(1 << 0);
+
+	tmr_regs->SCTRL = 0;
+	tmr_regs->LOAD = 0;
+	tmr_regs->CNTR = 0;
+	tmr_regs->COMP1 = tmr_tick_counts;
+
+	/* Interrupción cuando el contador alcanza COMP1 */
+	tmr_regs->CSCTRL = 0;
+	tmr_regs->TCF1EN = 1;
+
+	/* Contador libre (LENGTH = 0) ascendente de flancos del reloj del bus / 8 */
+	tmr_regs->CTRL = (TMR_CM_RISING_EDGES << 13) | (TMR_PCS_DIV_8 << 9);
+
+	tmr_ticks = 0;
+	tmr_us = 0;
+	tmr_last_comp = 0;
+
+	itc_set_priority (itc_src_tmr, itc_priority_normal);
+	itc_set_handler (itc_src_tmr, tmr_isr);
+	itc_enable_interrupt (itc_src_tmr);
+
+	tmr_regs->ENBL |= (1 << 0);
+
+	bsp_register_dev (name, 0, NULL, NULL, tmr_read, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL);
+
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Añade una función que se llamará en cada tick
+ * La función se ejecuta en la isr del temporizador, así que debe ser breve y
+ * diferir con bsp_work_post el trabajo que no lo sea
+ * @param hook	Función a llamar
+ * @return		Cero en caso de éxito o -1 en caso de error.
+ * 				La condición de error se indica en la variable global errno
+ */
+int32_t tmr_add_tick_hook (tmr_tick_hook_t hook)
+{
+	if (hook == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+	if (tmr_num_tick_hooks == TMR_MAX_TICK_HOOKS) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	/* La función debe estar en la tabla antes de que la isr la vea */
+	tmr_tick_hooks[tmr_num_tick_hooks] = hook;
+	asm volatile ("" : : : "memory");
+	tmr_num_tick_hooks++;
+
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Retorna el número de ticks transcurridos desde la inicialización del temporizador
+ */
+uint32_t bsp_ticks (void)
+{
+	return tmr_ticks;
+}
+
+/*****************************************************************************/
+
+/**
+ * Retorna el número de microsegundos transcurridos desde la inicialización del
+ * temporizador. El valor es monotónico y no se desborda en la práctica
+ */
+uint64_t bsp_time_us (void)
+{
+	uint32_t ticks;
+	uint64_t us;
+	uint16_t comp, cntr;
+
+	/* Repetimos la lectura si la isr se ha ejecutado en medio */
+	do {
+		ticks = tmr_ticks;
+		us = tmr_us;
+		comp = tmr_last_comp;
+		cntr = tmr_regs->CNTR;
+	} while (ticks != tmr_ticks);
+
+	/* El contador es libre, así que la diferencia es correcta aunque el tick
+	   actual esté pendiente de servirse */
+	return us + (uint16_t) (cntr - comp) / TMR_COUNTS_PER_US;
+}
+
+/*****************************************************************************/
+
+/**
+ * Retorna el número de ciclos de la CPU transcurridos desde la inicialización
+ * del temporizador. Se obtiene del mismo contador que el reloj del sistema, que
+ * cuenta ciclos del reloj del bus divididos por 8, así que la resolución es de
+ * 8 ciclos. Sirve para medir el coste de fragmentos de código
+ */
+uint64_t bsp_cycles (void)
+{
+	uint32_t ticks;
+	uint64_t us;
+	uint16_t comp, cntr;
+
+	do {
+		ticks = tmr_ticks;
+		us = tmr_us;
+		comp = tmr_last_comp;
+		cntr = tmr_regs->CNTR;
+	} while (ticks != tmr_ticks);
+
+	return (us * TMR_COUNTS_PER_US + (uint16_t) (cntr - comp)) * 8;
+}
+
+/*****************************************************************************/
+
+/**
+ * Duerme durante el tiempo indicado
+ * La CPU se detiene hasta cada interrupción en vez de esperar activamente.
+ * Mientras tanto se ejecutan los trabajos diferidos por las ISR. La precisión
+ * es de un tick
+ * @param us	Tiempo en microsegundos
+ */
+void bsp_sleep_us (uint32_t us)
+{
+	uint64_t end = bsp_time_us () + us;
+
+	while (bsp_time_us () < end)
+	{
+		bsp_run_pending ();
+		crm_wait_for_interrupt ();
+	}
+}
+
+/*****************************************************************************/
+
+/**
+ * Manejador de interrupciones del temporizador
+ * Programa el siguiente tick, actualiza el reloj del sistema y llama a las
+ * funciones de tick
+ */
+static void tmr_isr (void)
+{
+	uint16_t comp = tmr_regs->COMP1;
+	uint32_t i;
+
+	/* Limpiamos el flag de la comparación */
+	tmr_regs->TCF1 = 0;
+
+	/* El siguiente tick se programa respecto al actual, no al contador, para
+	   que la latencia de la isr no introduzca deriva */
+	tmr_regs->COMP1 = comp + tmr_tick_counts;
+
+	tmr_last_comp = comp;
+	tmr_us += tmr_tick_us;
+	tmr_ticks++;
+
+	for (i = 0; i < tmr_num_tick_hooks; i++)
+		tmr_tick_hooks[i] ();
+}
+
+/*****************************************************************************/
@@ -5,6 +5,8 @@
 
 #include <fcntl.h>
 #include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
 #include "system.h"
 #include "circular_buffer.h"
 
@@ -125,16 +127,32 @@ static void uart_1_isr (void);
 static void uart_2_isr (void);
 static const itc_handler_t uart_irq_handlers[uart_max] = {uart_1_isr, uart_2_isr};
 
+static void uart_tick_hook (void);
+static int uart_fstat (uint32_t id, struct stat *buf);
+static int uart_poll (uint32_t id, int events);
+static int uart_ioctl (uint32_t id, uint32_t request, void *arg);
+
 /*****************************************************************************/
 
 /**
  * Tamaño de los búferes circulares
+ * Se fijan en "system.h" para cada uart y sentido, y deben ser potencias de dos
  */
-#define __UART_BUFFER_SIZE__	256
+CIRCULAR_BUFFER_CHECK_SIZE (UART1_RX_BUFFER, UART1_RX_BUFFER_SIZE);
+CIRCULAR_BUFFER_CHECK_SIZE (UART1_TX_BUFFER, UART1_TX_BUFFER_SIZE);
+CIRCULAR_BUFFER_CHECK_SIZE (UART2_RX_BUFFER, UART2_RX_BUFFER_SIZE);
+CIRCULAR_BUFFER_CHECK_SIZE (UART2_TX_BUFFER, UART2_TX_BUFFER_SIZE);
 
 /* Reservamos espacio para los buffers "circulares"*/
-static volatile uint8_t uart_rx_buffers[uart_max][__UART_BUFFER_SIZE__];
-static volatile uint8_t uart_tx_buffers[uart_max][__UART_BUFFER_SIZE__];
+static uint8_t uart_1_rx_buffer[UART1_RX_BUFFER_SIZE];
+static uint8_t uart_1_tx_buffer[UART1_TX_BUFFER_SIZE];
+static uint8_t uart_2_rx_buffer[UART2_RX_BUFFER_SIZE];
+static uint8_t uart_2_tx_buffer[UART2_TX_BUFFER_SIZE];
+
+static uint8_t * const uart_rx_buffers[uart_max] = {uart_1_rx_buffer, uart_2_rx_buffer};
+static uint8_t * const uart_tx_buffers[uart_max] = {uart_1_tx_buffer, uart_2_tx_buffer};
+static const uint32_t uart_rx_buffer_sizes[uart_max] = {UART1_RX_BUFFER_SIZE, UART2_RX_BUFFER_SIZE};
+static const uint32_t uart_tx_buffer_sizes[uart_max] = {UART1_TX_BUFFER_SIZE, UART2_TX_BUFFER_SIZE};
 
 /* Instanciamos las estructuras de buffers que harán uso de la reserva anterior*/
 static volatile circular_buffer_t uart_circular_rx_buffers[uart_max];
@@ -145,26 +163,264 @@ static volatile circular_buffer_t uart_circular_tx_buffers[uart_max];
 
 /**
  * Gestión de las callbacks
+ * Las isr no llaman a las callbacks, sino que encolan su ejecución en la cola
+ * de trabajo diferido para que se ejecuten en modo usuario. Los flags *_pending
+ * evitan encolar una callback que ya está pendiente de ejecutarse
  */
 typedef struct
 {
 	uart_callback_t tx_callback;
 	uart_callback_t rx_callback;
+	uint32_t tx_pending;
+	uint32_t rx_pending;
 } uart_callbacks_t;
 
 static volatile uart_callbacks_t uart_callbacks[uart_max];
 
 /*****************************************************************************/
 
+/**
+ * Niveles por defecto de las FIFO: una interrupción por cada byte recibido y
+ * otra cuando la FIFO de transmisión se queda con un solo byte
+ */
+#define UART_DEFAULT_RX_LEVEL	1
+#define UART_DEFAULT_TX_LEVEL	31
+
+/**
+ * Niveles de las FIFO y agrupación de interrupciones de recepción
+ * La uart interrumpe cuando su FIFO de recepción alcanza rx_level bytes. Si
+ * idle_ticks no es cero, la función de tick vigila la FIFO y, si lleva
+ * idle_ticks ticks con bytes y sin recibir ninguno más, fuerza el nivel a 1
+ * (forced) para que la isr la vacíe. El nivel se restablece tras vaciarla
+ */
+typedef struct
+{
+	uint32_t rx_level;
+	uint32_t tx_level;
+	uint32_t idle_bits;
+	uint32_t idle_ticks;
+	uint32_t idle_count;
+	uint32_t last_count;
+	uint32_t forced;
+} uart_watermarks_t;
+
+static volatile uart_watermarks_t uart_watermarks[uart_max];
+
+/**
+ * Baudrate de cada uart, para traducir tiempos de bit a ticks
+ */
+static uint32_t uart_baudrates[uart_max];
+
+/**
+ * Indica si la función de tick de las uart ya se registró
+ */
+static uint32_t uart_tick_hook_added = 0;
+
+/**
+ * Indica qué uart tienen activado el control de flujo hardware
+ */
+static uint32_t uart_flow_control[uart_max];
+
+/*****************************************************************************/
+
+/**
+ * Bits de error del registro de estado. Se borran al leerlo
+ */
+#define UART_STAT_PE	(1 << 1)
+#define UART_STAT_FE	(1 << 2)
+#define UART_STAT_TOE	(1 << 3)
+#define UART_STAT_ROE	(1 << 4)
+#define UART_STAT_RUE	(1 << 5)
+
+/**
+ * Estadísticas de errores de cada uart
+ * Los bytes recibidos y transmitidos no se cuentan aquí: son los contadores
+ * libres de los búferes circulares
+ */
+static volatile uart_stats_t uart_stats[uart_max];
+
+/*****************************************************************************/
+
+/**
+ * Contexto del manejador FIQ de las uart (uart_fiq.s)
+ * Cuando una uart trabaja en modo FIQ, el ITC encamina todas sus interrupciones
+ * a la FIQ y es el manejador en ensamblador el que vacía la FIFO de recepción
+ * y llena la de transmisión, sin pasar por la tabla de manejadores del ITC.
+ * Una entrada con regs a NULL indica que la uart trabaja en modo IRQ.
+ * uart_fiq.s accede a los campos por su desplazamiento, por lo que no debe
+ * alterarse su orden
+ */
+typedef struct
+{
+	volatile uart_regs_t *regs;
+	volatile circular_buffer_t *rx;
+	volatile circular_buffer_t *tx;
+} uart_fiq_ctx_t;
+
+uart_fiq_ctx_t uart_fiq_ctx[uart_max];
+
+/**
+ * Manejador FIQ de las uart, implementado en uart_fiq.s
+ */
+extern void uart_fiq_handler (void);
+
+/*****************************************************************************/
+
+/**
+ * Límite de INC + 1 y MOD + 1, que ocupan 16 bits en el registro BR
+ */
+#define UART_BR_MAX		0x10000
+
+/**
+ * Configuración del generador de frecuencia de una uart
+ */
+typedef struct
+{
+	uint32_t inc;
+	uint32_t mod;
+	uint32_t xtim;			/* 1 para sobremuestreo 8x, 0 para 16x */
+	int32_t error_ppm;
+} uart_baud_t;
+
+/*****************************************************************************/
+
+/**
+ * Retorna |p * den - q * num|, que es proporcional a la distancia entre las
+ * fracciones p / q y num / den
+ */
+static inline uint64_t uart_ratio_diff (uint32_t p, uint32_t q, uint32_t num, uint32_t den)
+{
+	uint64_t a = (uint64_t) p * den, b = (uint64_t) q * num;
+
+	return a > b ? a - b : b - a;
+}
+
+/*****************************************************************************/
+
+/**
+ * Aproxima num / den, menor que 1, por la fracción p / q más cercana con
+ * q <= UART_BR_MAX
+ * Desarrolla num / den en fracción continua. Los convergentes son las mejores
+ * aproximaciones para su denominador; cuando el siguiente se pasa del límite,
+ * la mejor fracción es el último convergente o el mayor semiconvergente que
+ * cabe, así que se comparan ambos
+ * @param num	Numerador
+ * @param den	Denominador
+ * @param p		Numerador de la aproximación
+ * @param q		Denominador de la aproximación
+ */
+static void uart_baud_ratio (uint32_t num, uint32_t den, uint32_t *p, uint32_t *q)
+{
+	uint32_t h0 = 0, k0 = 1, h1 = 1, k1 = 0;
+	uint32_t x = num, y = den;
+	uint32_t a, h2, k2, r;
+	uint64_t e1, e2;
+
+	while (y) {
+		a = x / y;
+		h2 = a * h1 + h0;
+		k2 = a * k1 + k0;
+
+		if (k2 > UART_BR_MAX) {
+			/* Semiconvergente con el mayor término que cabe */
+			a = (UART_BR_MAX - k0) / k1;
+			h2 = a * h1 + h0;
+			k2 = a * k1 + k0;
+
+			/* Nos quedamos con el semiconvergente si |h2/k2 - num/den| es
+			menor que |h1/k1 - num/den|, comparando en enteros */
+			e1 = uart_ratio_diff (h1, k1, num, den) * k2;
+			e2 = uart_ratio_diff (h2, k2, num, den) * k1;
+			if (a && e2 < e1) {
+				h1 = h2;
+				k1 = k2;
+			}
+			break;
+		}
+
+		h0 = h1; k0 = k1;
+		h1 = h2; k1 = k2;
+		r = x - a * y;
+		x = y;
+		y = r;
+	}
+
+	*p = h1;
+	*q = k1;
+}
+
+/*****************************************************************************/
+
+/**
+ * Calcula INC y MOD para un baudrate con el menor error posible
+ * La uart genera baudrate = CPU_FREQ * (INC + 1) / ((MOD + 1) * sobremuestreo),
+ * con INC < MOD. Se prueban los sobremuestreos de 16x y 8x, y se prefiere 16x,
+ * que tolera mejor el ruido, si el error es el mismo
+ * @param br	Baudrate
+ * @param baud	Configuración calculada
+ * @return		Cero en caso de éxito o -1 si el baudrate no es alcanzable
+ */
+static int32_t uart_baud_solve (uint32_t br, uart_baud_t *baud)
+{
+	static const uint32_t os[2] = {16, 8};
+	uint32_t i, p, q, found = 0;
+	int64_t target, err;
+
+	for (i = 0; i < 2; i++) {
+		/* Fuera de rango para este sobremuestreo */
+		if (br == 0 || (uint64_t) br * os[i] >= CPU_FREQ)
+			continue;
+
+		uart_baud_ratio (br * os[i], CPU_FREQ, &p, &q);
+		if (p == 0 || p >= q)
+			continue;
+
+		/* Error relativo en partes por millón */
+		target = (int64_t) br * os[i] * q;
+		err = ((int64_t) CPU_FREQ * p - target) * 1000000 / target;
+
+		if (!found || (err < 0 ? -err : err) < (baud->error_ppm < 0 ? -baud->error_ppm : baud->error_ppm)) {
+			baud->inc = p - 1;
+			baud->mod = q - 1;
+			baud->xtim = i;
+			baud->error_ppm = err;
+			found = 1;
+		}
+	}
+
+	return found ? 0 : -1;
+}
+
+/*****************************************************************************/
+
+/**
+ * Traduce el tiempo de silencio de una uart, en tiempos de bit, a ticks del
+ * sistema, redondeando hacia arriba
+ * @param uart	Identificador de la uart
+ * @return		Los ticks, o cero si no hay tiempo de silencio
+ */
+static uint32_t uart_idle_ticks (uart_id_t uart)
+{
+	uint32_t bits = uart_watermarks[uart].idle_bits;
+
+	if (bits == 0)
+		return 0;
+
+	return ((uint64_t) bits * BSP_TICK_HZ + uart_baudrates[uart] - 1) / uart_baudrates[uart];
+}
+
+/*****************************************************************************/
+
 /**
  * Inicializa una uart
  * @param uart	Identificador de la uart
  * @param br	Baudrate
  * @param name	Nombre del dispositivo
+ * @param rx_mode	Modo de atención de las interrupciones (IRQ o FIQ)
  * @return		Cero en caso de éxito o -1 en caso de error.
  * 				La condición de error se indica en la variable global errno
  */
-int32_t uart_init (uart_id_t uart, uint32_t br, const char *name)
+int32_t uart_init (uart_id_t uart, uint32_t br, const char *name, uart_rx_mode_t rx_mode)
 {
 	//comprobamos errores
 	if (uart > uart_2) {
@@ -177,18 +433,26 @@ int32_t uart_init (uart_id_t uart, uint32_t br, const char *name)
 		return -1;
 	}
 
+	if (rx_mode >= uart_rx_max) {
+		errno=EINVAL;
+		return -1;
+	}
+
+	uart_baud_t baud;
 
-	uint32_t inc, mod;
+	if (uart_baud_solve (br, &baud) < 0) {
+		errno=EINVAL;
+		return -1;
+	}
 
     /* Fijamos los parámetros por defecto y deshabilitamos la uart */
 	/* La uart debe estar deshabilitada para fijar la frecuencia */
 	uart_regs[uart]->CON =	(1 << 13) |		/* MTxR = 1 - Enmascaramos las interrupciones */
-							(1 << 14);		/* MRxR = 1 */
+							(1 << 14) |		/* MRxR = 1 */
+							(baud.xtim << 10);	/* xTIM - Sobremuestreo de 8x o 16x */
 
 	/* Una vez fijado xTIM, y con la UART desabilitada, fijamos la frecuencia */
-	mod = 9999;
-	inc = br*mod/(CPU_FREQ>>4);			/* Asumimos un oversampling de 8x */
-	uart_regs[uart]->BR = ( inc << 16 ) | mod;
+	uart_regs[uart]->BR = ( baud.inc << 16 ) | baud.mod;
 
 	/* Hay que habilitar el periférico antes fijar el modo de funcionamiento de sus pines en GPIO_FUNC_SEL */
 	/* Consultar la sección 11.5.1.2 Alternate Modes del datasheet: */
@@ -213,35 +477,65 @@ int32_t uart_init (uart_id_t uart, uint32_t br, const char *name)
 	/*instanciamos la estructura de buffers (para rx y tx) indicandoles
 	la zona de memoria donde pueden existir y su tamaño*/
 	circular_buffer_init( & uart_circular_rx_buffers[uart],
-		(uint8_t *)uart_rx_buffers[uart], __UART_BUFFER_SIZE__);
+		uart_rx_buffers[uart], uart_rx_buffer_sizes[uart]);
 	circular_buffer_init( & uart_circular_tx_buffers[uart],
-		(uint8_t *)uart_tx_buffers[uart], __UART_BUFFER_SIZE__);
+		uart_tx_buffers[uart], uart_tx_buffer_sizes[uart]);
 
 	/*indicamos el máximo número de bytes vacíos que puede tener la cola
 	de envío antes de avisar a la cpu*/
-	uart_regs[uart]->TxLevel = 31;
+	uart_regs[uart]->TxLevel = UART_DEFAULT_TX_LEVEL;
 	/*indicamos los bytes que debe haber recibido el buffer de recepción
 	antes de avisar a la cpu para que los retiren*/
-	uart_regs[uart]->RxLevel = 1;
-
-
-		/*le decimos al controlador de interrupciones que asigne
-		la uart a la entrada IRQ de la CPU*/
-		itc_set_priority(itc_src_uart1+uart, itc_priority_normal);
-		/*le indicamos el manejador de la interrupción*/
-		itc_set_handler(itc_src_uart1+uart, uart_irq_handlers[uart]);
+	uart_regs[uart]->RxLevel = UART_DEFAULT_RX_LEVEL;
+
+	/*sin agrupación de interrupciones mientras no se pida*/
+	uart_baudrates[uart] = br;
+	uart_watermarks[uart].rx_level = UART_DEFAULT_RX_LEVEL;
+	uart_watermarks[uart].tx_level = UART_DEFAULT_TX_LEVEL;
+	uart_watermarks[uart].idle_bits = 0;
+	uart_watermarks[uart].idle_ticks = 0;
+	uart_watermarks[uart].forced = 0;
+	uart_flow_control[uart] = 0;
+
+	/*estadísticas a cero, descartando los errores anteriores*/
+	(void) uart_regs[uart]->STAT;
+	memset ((void *) & uart_stats[uart], 0, sizeof (uart_stats_t));
+
+
+		if (rx_mode == uart_rx_fiq) {
+			/*el manejador FIQ atiende directamente a la uart con los
+			búferes indicados en su contexto*/
+			uart_fiq_ctx[uart].rx = & uart_circular_rx_buffers[uart];
+			uart_fiq_ctx[uart].tx = & uart_circular_tx_buffers[uart];
+			uart_fiq_ctx[uart].regs = uart_regs[uart];
+			excep_set_handler(excep_fiq, uart_fiq_handler);
+			/*le decimos al controlador de interrupciones que asigne
+			la uart a la entrada FIQ de la CPU*/
+			itc_set_priority(itc_src_uart1+uart, itc_priority_fast);
+		}
+		else {
+			uart_fiq_ctx[uart].regs = NULL;
+			/*le decimos al controlador de interrupciones que asigne
+			la uart a la entrada IRQ de la CPU*/
+			itc_set_priority(itc_src_uart1+uart, itc_priority_normal);
+			/*le indicamos el manejador de la interrupción*/
+			itc_set_handler(itc_src_uart1+uart, uart_irq_handlers[uart]);
+		}
 		/*activamos las interrupciones del uart*/
 		itc_enable_interrupt(itc_src_uart1 + uart);
 
 		/*sin funciones callback en primera instancia*/
 		uart_callbacks[uart].tx_callback = NULL;
 		uart_callbacks[uart].rx_callback = NULL;
+		uart_callbacks[uart].tx_pending = 0;
+		uart_callbacks[uart].rx_pending = 0;
 
 		/*rehabilitamos interrupciones por recepción*/
 		uart_regs[uart]->mRxR = 0;
 
 		/*para L2*/
-		bsp_register_dev (name, uart, NULL, NULL, uart_receive, uart_send, NULL, NULL, NULL);
+		bsp_register_dev (name, uart, NULL, NULL, uart_receive, uart_send, NULL, uart_fstat, NULL,
+				uart_receivev, uart_sendv, uart_poll, uart_ioctl);
 
 
 	return 0;
@@ -250,74 +544,164 @@ int32_t uart_init (uart_id_t uart, uint32_t br, const char *name)
 /*****************************************************************************/
 
 /**
- * Transmite un byte por la uart
- * Implementación del driver de nivel 0. La llamada se bloquea hasta que transmite el byte
+ * Desenmascara la recepción si la isr la enmascaró por tener el búfer lleno
+ * Sin control de flujo basta con que haya hueco. Con control de flujo se espera
+ * a que el búfer baje de la mitad, para que CTS no se active y desactive con
+ * cada byte que se lee
  * @param uart	Identificador de la uart
- * @param c		El carácter
  */
-
-/*envío bloqueante de 1 byte*/
-void uart_send_byte (uart_id_t uart, uint8_t c)
+static inline void uart_rx_resume (uart_id_t uart)
 {
-	/* driver L0
-	while (uart_regs[uart]->Tx_fifo_addr_diff == 0);
-	uart_regs[uart]->Tx_data = c;*/
+	uint32_t state;
 
-	uint32_t aux = uart_regs[uart]->mTxR;
-	/*desactivamos interrupciones del transmisor*/
-	uart_regs[uart]->mTxR = 1;
+	if (!uart_regs[uart]->mRxR)
+		return;
 
-	/*terminamos las escrituras pendientes ya que tienen
-	mayor prioridad que la que vamos a hacer ahora*/
-	while (!circular_buffer_is_empty(& uart_circular_tx_buffers[uart])) {
-		while (! uart_regs[uart]->Tx_fifo_addr_diff){
-			/*esperamos a que haya algún hueco libre en la cola de envío*/
-		};
-		uart_regs[uart]->Tx_data = circular_buffer_read(& uart_circular_tx_buffers[uart]);
+	if (uart_flow_control[uart] &&
+		circular_buffer_count (& uart_circular_rx_buffers[uart]) > uart_rx_buffer_sizes[uart] / 2)
+		return;
+
+	/* Las isr también modifican CON, así que no deben ejecutarse entre la
+	lectura y la escritura del campo de bits */
+	state = excep_critical_enter ();
+	if (uart_regs[uart]->mRxR) {
+		/* Contamos aquí los llenados del búfer para incluir los del modo FIQ */
+		uart_stats[uart].rx_ring_full++;
+		uart_regs[uart]->mRxR = 0;
 	}
+	excep_critical_exit (state);
+}
 
+/*****************************************************************************/
 
-	while (!uart_regs[uart]->Tx_fifo_addr_diff){
-		/*ahora ya podemos mandar el dato. Volvemos a esperar a que haya
-		sitio en la cola de envío antes de hacerlo*/
+/**
+ * Desenmascara la transmisión para que la isr vacíe el búfer
+ * @param uart	Identificador de la uart
+ */
+static inline void uart_tx_unmask (uart_id_t uart)
+{
+	uint32_t state;
+
+	/* Las isr también modifican CON, así que no deben ejecutarse entre la
+	lectura y la escritura del campo de bits */
+	state = excep_critical_enter ();
+	uart_regs[uart]->mTxR = 0;
+	excep_critical_exit (state);
+}
+
+/*****************************************************************************/
+
+/**
+ * Comprueba que se puede escribir en el búfer de transmisión
+ * El búfer sólo admite un productor, el código de usuario. Una isr que escribe
+ * en él (por ejemplo, con printf) podría intercalarse con una escritura a
+ * medias del código al que interrumpe, así que se rechaza
+ * @return	Cero si se puede escribir o -1 dentro de una isr (EAGAIN)
+ */
+static inline int32_t uart_tx_producer_check (void)
+{
+	if (bsp_in_isr ()) {
+		errno = EAGAIN;
+		return -1;
 	}
-	uart_regs[uart]->Tx_data = c;
 
-	//restauramos el valor que tuviese mtxr
-	uart_regs[uart]->mTxR = aux;
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Acumula en las estadísticas de una uart los errores de su registro de estado
+ * Debe llamarse con las interrupciones de la uart deshabilitadas
+ * @param uart	Identificador de la uart
+ * @param status	Valor leído del registro de estado
+ */
+static inline void uart_account_status (uart_id_t uart, uint32_t status)
+{
+	if (!(status & (UART_STAT_PE | UART_STAT_FE | UART_STAT_TOE | UART_STAT_ROE | UART_STAT_RUE)))
+		return;
+
+	if (status & UART_STAT_PE)
+		uart_stats[uart].parity_errors++;
+	if (status & UART_STAT_FE)
+		uart_stats[uart].framing_errors++;
+	if (status & UART_STAT_ROE)
+		uart_stats[uart].rx_overruns++;
+	if (status & UART_STAT_RUE)
+		uart_stats[uart].rx_underruns++;
+	if (status & UART_STAT_TOE)
+		uart_stats[uart].tx_overruns++;
+}
 
+/*****************************************************************************/
 
+/**
+ * Indica si la isr de las uart puede ejecutarse
+ * Si no puede, las llamadas de nivel 0 no pueden esperar a que libere espacio
+ * o reciba bytes, y atienden directamente las FIFO
+ */
+static inline uint32_t uart_isr_can_run (void)
+{
+	return !bsp_in_isr () && excep_irq_enabled ();
+}
+
+/*****************************************************************************/
+
+/**
+ * Transmite un byte por la uart
+ * Implementación del driver de nivel 0. El byte se encola en el búfer de
+ * transmisión detrás de los pendientes. Si el búfer está lleno, la CPU se
+ * detiene hasta que la isr le hace hueco. Dentro de una isr o con las IRQ
+ * deshabilitadas el byte se escribe directamente en la FIFO, esperando
+ * activamente a que tenga hueco, así que puede adelantar a los pendientes. Así
+ * sirve para mensajes de error fatal
+ * @param uart	Identificador de la uart
+ * @param c		El carácter
+ */
+void uart_send_byte (uart_id_t uart, uint8_t c)
+{
+	if (!uart_isr_can_run ())
+	{
+		while (uart_regs[uart]->Tx_fifo_addr_diff == 0)
+			;
+		uart_regs[uart]->Tx_data = c;
+		return;
+	}
+
+	while (circular_buffer_write (& uart_circular_tx_buffers[uart], c) < 0)
+		crm_wait_for_interrupt ();
+
+	/* Hay datos pendientes, así que desenmascaramos la transmisión */
+	uart_tx_unmask (uart);
 }
 
 /*****************************************************************************/
 
 /**
  * Recibe un byte por la uart
- * Implementación del driver de nivel 0. La llamada se bloquea hasta que recibe el byte
+ * Implementación del driver de nivel 0. La llamada se bloquea hasta que recibe
+ * el byte, con la CPU detenida entre interrupciones. Dentro de una isr o con
+ * las IRQ deshabilitadas, cuando el búfer de recepción está vacío se espera
+ * activamente a que llegue el byte a la FIFO
  * @param uart	Identificador de la uart
  * @return		El byte recibido
  */
-
-/*recepción bloqueante de un byte*/
 uint8_t uart_receive_byte (uart_id_t uart)
 {
-		uint8_t recep;
-		uint32_t aux = uart_regs[uart]->mRxR;
-		/*desactivamos interrupciones del receptor*/
-		uart_regs[uart]->mRxR = 1;
+	int32_t c;
 
-		if(!circular_buffer_is_empty(& uart_circular_rx_buffers[uart])){
-			recep = circular_buffer_read(& uart_circular_rx_buffers[uart]);
-		}
-		else{
-			while (uart_regs[uart]->Rx_fifo_addr_diff == 0);
-			recep= uart_regs[uart]->Rx_data;
-		}
+	while ((c = circular_buffer_read (& uart_circular_rx_buffers[uart])) < 0)
+	{
+		if (uart_isr_can_run ())
+			crm_wait_for_interrupt ();
+		else if (uart_regs[uart]->Rx_fifo_addr_diff)
+			return uart_regs[uart]->Rx_data;
+	}
 
-		//restauramos el valor que tuviese mtxr
-		uart_regs[uart]->mRxR = aux;
+	/* Si la isr enmascaró la recepción por tener el búfer lleno, ya hay hueco */
+	uart_rx_resume (uart);
 
-		return recep;
+	return c;
 }
 
 /*****************************************************************************/
@@ -344,12 +728,17 @@ ssize_t uart_send (uint32_t uart, char *buf, size_t count)
 		return -1;
 	}
 
-	uart_regs[uart]->mTxR = 1;
+	if (uart_tx_producer_check () < 0)
+		return -1;
+
+	/* El búfer es SPSC: somos su único productor y la isr su único consumidor,
+	así que no hace falta enmascarar la interrupción de transmisión */
 	size_t i;
-	for (i = 0; i < count && !circular_buffer_is_full( & uart_circular_tx_buffers[uart] ); i++)
-		circular_buffer_write(& uart_circular_tx_buffers[uart], buf[i]);
+	i = circular_buffer_write_block (& uart_circular_tx_buffers[uart], (uint8_t *) buf, count);
 
-	uart_regs[uart]->mTxR = 0;
+	/* Desenmascaramos la transmisión para que la isr vacíe el búfer */
+	if (i)
+		uart_tx_unmask (uart);
 
 	//indicamos cuánto se ha mandado
   return i;
@@ -378,12 +767,14 @@ ssize_t uart_receive (uint32_t uart, char *buf, size_t count)
 		errno = EFAULT;
 		return -1;
 	}
-	uart_regs[uart]->mRxR = 1;
+	/* El búfer es SPSC: la isr es su único productor y nosotros su único
+	consumidor, así que no hace falta enmascarar la interrupción de recepción */
 	size_t i;
-	for (i = 0; i < count && !circular_buffer_is_empty( & uart_circular_rx_buffers[uart] ); i++)
-		buf[i] = circular_buffer_read(& uart_circular_rx_buffers[uart]);
+	i = circular_buffer_read_block (& uart_circular_rx_buffers[uart], (uint8_t *) buf, count);
 
-		uart_regs[uart]->mRxR = 0;
+	/* Si la isr enmascaró la recepción por tener el búfer lleno, ya hay hueco */
+	if (i)
+		uart_rx_resume (uart);
 
 	//indicamos cuánto se ha recibido
   return i;
@@ -392,11 +783,246 @@ ssize_t uart_receive (uint32_t uart, char *buf, size_t count)
 
 /*****************************************************************************/
 
+/**
+ * Transmisión vectorizada de bytes
+ * Implementación del driver de nivel 1. Encola los tramos en orden
+ * directamente en el búfer de transmisión y desenmascara la transmisión una
+ * sola vez. La llamada es no bloqueante: se detiene en el primer tramo que no
+ * cabe entero
+ * @param uart	Identificador de la uart
+ * @param iov	Tramos con los caracteres
+ * @param iovcnt	Número de tramos
+ * @return	El número total de bytes almacenados en el búfer de transmisión
+ *              en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+ssize_t uart_sendv (uint32_t uart, const bsp_iovec_t *iov, int iovcnt)
+{
+	size_t total = 0, n;
+	int i;
+
+	if (uart > uart_2) {
+		errno = ENODEV;
+		return -1;
+	}
+	if (iov == NULL && iovcnt > 0) {
+		errno = EFAULT;
+		return -1;
+	}
+
+	if (uart_tx_producer_check () < 0)
+		return -1;
+
+	for (i = 0; i < iovcnt; i++) {
+		n = circular_buffer_write_block (& uart_circular_tx_buffers[uart],
+				(uint8_t *) iov[i].iov_base, iov[i].iov_len);
+		total += n;
+		if (n < iov[i].iov_len)
+			break;
+	}
+
+	/* Desenmascaramos la transmisión para que la isr vacíe el búfer */
+	if (total)
+		uart_tx_unmask (uart);
+
+	return total;
+}
+
+/*****************************************************************************/
+
+/**
+ * Recepción vectorizada de bytes
+ * Implementación del driver de nivel 1. Reparte los bytes recibidos entre los
+ * tramos, en orden. La llamada es no bloqueante: se detiene cuando no quedan
+ * bytes recibidos
+ * @param uart	Identificador de la uart
+ * @param iov	Tramos donde almacenar los bytes
+ * @param iovcnt	Número de tramos
+ * @return	El número total de bytes leídos en caso de éxito o -1 en caso de
+ *              error.
+ * 		La condición de error se indica en la variable global errno
+ */
+ssize_t uart_receivev (uint32_t uart, const bsp_iovec_t *iov, int iovcnt)
+{
+	size_t total = 0, n;
+	int i;
+
+	if (uart > uart_2) {
+		errno = ENODEV;
+		return -1;
+	}
+	if (iov == NULL && iovcnt > 0) {
+		errno = EFAULT;
+		return -1;
+	}
+
+	for (i = 0; i < iovcnt; i++) {
+		n = circular_buffer_read_block (& uart_circular_rx_buffers[uart],
+				(uint8_t *) iov[i].iov_base, iov[i].iov_len);
+		total += n;
+		if (n < iov[i].iov_len)
+			break;
+	}
+
+	/* Si la isr enmascaró la recepción por tener el búfer lleno, ya hay hueco */
+	if (total)
+		uart_rx_resume (uart);
+
+	return total;
+}
+
+/*****************************************************************************/
+
+/**
+ * Recepción de bytes con tiempo límite
+ * Si no hay bytes recibidos, la CPU se detiene entre interrupciones hasta que
+ * llega alguno o vence el plazo. No debe llamarse con las IRQ deshabilitadas
+ * @param uart	Identificador de la uart
+ * @param buf	Búfer para almacenar los bytes
+ * @param count	Número de bytes a leer
+ * @param timeout_us	Tiempo máximo de espera en microsegundos
+ * @return	El número de bytes realmente leídos, cero si venció el plazo, o
+ *              -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+ssize_t uart_read_timeout (uart_id_t uart, char *buf, size_t count, uint32_t timeout_us)
+{
+	uint64_t end;
+
+	if (uart > uart_2) {
+		errno = ENODEV;
+		return -1;
+	}
+
+	end = bsp_time_us () + timeout_us;
+	while (circular_buffer_is_empty (& uart_circular_rx_buffers[uart]) && bsp_time_us () < end)
+		crm_wait_for_interrupt ();
+
+	return uart_receive (uart, buf, count);
+}
+
+/*****************************************************************************/
+
+/**
+ * Consulta los bytes recibidos sin copiarlos
+ * Permite procesar los datos directamente sobre el búfer circular de recepción.
+ * Los bytes no se extraen hasta llamar a uart_rx_consume
+ * @param uart	Identificador de la uart
+ * @param spans	Los dos tramos del búfer de recepción con los bytes recibidos
+ * @return	El número total de bytes disponibles en caso de éxito o
+ *              -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+ssize_t uart_rx_peek (uart_id_t uart, circular_buffer_span_t spans[2])
+{
+	if (uart > uart_2) {
+		errno = ENODEV;
+		return -1;
+	}
+	if (spans == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+
+	return circular_buffer_peek (& uart_circular_rx_buffers[uart], spans);
+}
+
+/*****************************************************************************/
+
+/**
+ * Extrae bytes ya procesados del búfer de recepción
+ * @param uart	Identificador de la uart
+ * @param count	Número de bytes a extraer
+ * @return	El número de bytes realmente extraídos en caso de éxito o
+ *              -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+ssize_t uart_rx_consume (uart_id_t uart, size_t count)
+{
+	size_t i;
+
+	if (uart > uart_2) {
+		errno = ENODEV;
+		return -1;
+	}
+
+	i = circular_buffer_consume (& uart_circular_rx_buffers[uart], count);
+
+	/* Si la isr enmascaró la recepción por tener el búfer lleno, ya hay hueco */
+	if (i)
+		uart_rx_resume (uart);
+
+	return i;
+}
+
+/*****************************************************************************/
+
+/**
+ * Reserva el espacio libre del búfer de transmisión
+ * Permite generar los datos directamente sobre el búfer circular de
+ * transmisión. No se envían hasta llamar a uart_tx_commit
+ * @param uart	Identificador de la uart
+ * @param spans	Los dos tramos libres del búfer de transmisión
+ * @return	El número total de bytes libres en caso de éxito o
+ *              -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+ssize_t uart_tx_reserve (uart_id_t uart, circular_buffer_span_t spans[2])
+{
+	if (uart > uart_2) {
+		errno = ENODEV;
+		return -1;
+	}
+	if (spans == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+
+	if (uart_tx_producer_check () < 0)
+		return -1;
+
+	return circular_buffer_reserve (& uart_circular_tx_buffers[uart], spans);
+}
+
+/*****************************************************************************/
+
+/**
+ * Envía los bytes escritos en el espacio obtenido con uart_tx_reserve
+ * @param uart	Identificador de la uart
+ * @param count	Número de bytes escritos
+ * @return	El número de bytes realmente encolados para su envío en caso de
+ *              éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+ssize_t uart_tx_commit (uart_id_t uart, size_t count)
+{
+	size_t i;
+
+	if (uart > uart_2) {
+		errno = ENODEV;
+		return -1;
+	}
+
+	if (uart_tx_producer_check () < 0)
+		return -1;
+
+	i = circular_buffer_commit (& uart_circular_tx_buffers[uart], count);
+
+	/* Desenmascaramos la transmisión para que la isr vacíe el búfer */
+	if (i)
+		uart_tx_unmask (uart);
+
+	return i;
+}
+
+/*****************************************************************************/
+
 /**
  * Fija la función callback de recepción de una uart
  * @param uart	Identificador de la uart
  * @param func	Función callback. NULL para anular una selección anterior
- * @return	Cero en caso de éxito o -1 en caso de error.
+ * @return	Cero en caso de éxito o -1 en caso de error (ENOTSUP si la uart
+ * 		trabaja en modo FIQ).
  * 		La condición de error se indica en la variable global errno
  */
 int32_t uart_set_receive_callback (uart_id_t uart, uart_callback_t func)
@@ -405,6 +1031,12 @@ int32_t uart_set_receive_callback (uart_id_t uart, uart_callback_t func)
 			errno = ENODEV;
 			return -1;
 		}
+		/*en modo FIQ las interrupciones las atiende uart_fiq.s, que no
+		encola callbacks*/
+		if (func != NULL && uart_fiq_ctx[uart].regs != NULL) {
+			errno = ENOTSUP;
+			return -1;
+		}
 		uart_callbacks[uart].rx_callback = func;
 
 		return 0;
@@ -416,7 +1048,8 @@ int32_t uart_set_receive_callback (uart_id_t uart, uart_callback_t func)
  * Fija la función callback de transmisión de una uart
  * @param uart	Identificador de la uart
  * @param func	Función callback. NULL para anular una selección anterior
- * @return	Cero en caso de éxito o -1 en caso de error.
+ * @return	Cero en caso de éxito o -1 en caso de error (ENOTSUP si la uart
+ * 		trabaja en modo FIQ).
  * 		La condición de error se indica en la variable global errno
  */
 int32_t uart_set_send_callback (uart_id_t uart, uart_callback_t func)
@@ -425,6 +1058,12 @@ int32_t uart_set_send_callback (uart_id_t uart, uart_callback_t func)
 			errno = ENODEV;
 			return -1;
 		}
+		/*en modo FIQ las interrupciones las atiende uart_fiq.s, que no
+		encola callbacks*/
+		if (func != NULL && uart_fiq_ctx[uart].regs != NULL) {
+			errno = ENOTSUP;
+			return -1;
+		}
 		uart_callbacks[uart].tx_callback = func;
 
 		return 0;
@@ -432,6 +1071,397 @@ int32_t uart_set_send_callback (uart_id_t uart, uart_callback_t func)
 
 /*****************************************************************************/
 
+/**
+ * Cambia el baudrate de una uart
+ * Los bytes que estén en la FIFO de transmisión se cortan; los del búfer
+ * circular se envían después con el nuevo baudrate
+ * @param uart	Identificador de la uart
+ * @param br	Baudrate
+ * @param error_ppm	Si no es NULL, error del baudrate conseguido en partes por millón
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_set_baudrate (uart_id_t uart, uint32_t br, int32_t *error_ppm)
+{
+	uart_baud_t baud;
+	uint32_t con, state;
+
+	if (uart > uart_2) {
+		errno = ENODEV;
+		return -1;
+	}
+	if (uart_baud_solve (br, &baud) < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* La uart debe estar deshabilitada para fijar xTIM y la frecuencia. Las
+	isr cambian las máscaras de CON, así que no deben ejecutarse entre la
+	lectura y las escrituras */
+	state = excep_critical_enter ();
+	con = uart_regs[uart]->CON;
+	uart_regs[uart]->CON = con & ~((1 << 0) | (1 << 1));
+	uart_regs[uart]->CON = (con & ~((1 << 0) | (1 << 1) | (1 << 10))) | (baud.xtim << 10);
+	uart_regs[uart]->BR = ( baud.inc << 16 ) | baud.mod;
+	uart_regs[uart]->CON = (con & ~(1 << 10)) | (baud.xtim << 10);
+	excep_critical_exit (state);
+
+	/* El tiempo de silencio está en tiempos de bit */
+	uart_baudrates[uart] = br;
+	if (uart_watermarks[uart].idle_ticks)
+		uart_watermarks[uart].idle_ticks = uart_idle_ticks (uart);
+
+	if (error_ppm)
+		*error_ppm = baud.error_ppm;
+
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Fija los niveles de las FIFO de una uart y el tiempo de silencio tras el que
+ * se recogen los bytes que no alcanzan el nivel de recepción
+ * @param uart	Identificador de la uart
+ * @param rx_level	Bytes en la FIFO de recepción que provocan una interrupción (1-31)
+ * @param tx_level	Huecos en la FIFO de transmisión que provocan una interrupción (1-31)
+ * @param rx_idle_bits	Tiempos de bit sin recibir tras los que se vacía la
+ * 				FIFO de recepción, o cero para no vaciarla hasta alcanzar el nivel
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_set_watermarks (uart_id_t uart, uint32_t rx_level, uint32_t tx_level, uint32_t rx_idle_bits)
+{
+	volatile uart_watermarks_t *wm;
+	uint32_t idle_ticks = 0;
+
+	if (uart > uart_2) {
+		errno = ENODEV;
+		return -1;
+	}
+	if (rx_level < 1 || rx_level > UART_MAX_LEVEL || tx_level < 1 || tx_level > UART_MAX_LEVEL) {
+		errno = EINVAL;
+		return -1;
+	}
+	/* Con control de flujo, el otro extremo se detiene al llegar a UART_CTS_LEVEL */
+	if (uart_flow_control[uart] && rx_level >= UART_CTS_LEVEL) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* La función de tick sólo se registra la primera vez que se necesita */
+	if (rx_idle_bits && !uart_tick_hook_added) {
+		if (tmr_add_tick_hook (uart_tick_hook) < 0)
+			return -1;
+		uart_tick_hook_added = 1;
+	}
+
+	wm = & uart_watermarks[uart];
+	wm->idle_ticks = 0;
+	wm->idle_bits = rx_idle_bits;
+	idle_ticks = uart_idle_ticks (uart);
+	wm->rx_level = rx_level;
+	wm->tx_level = tx_level;
+	wm->idle_count = 0;
+	wm->last_count = 0;
+	wm->forced = 0;
+
+	uart_regs[uart]->TxLevel = tx_level;
+	uart_regs[uart]->RxLevel = rx_level;
+
+	/* La función de tick no vigila la uart hasta que todo está listo */
+	wm->idle_ticks = idle_ticks;
+
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Activa o desactiva el control de flujo hardware (RTS/CTS) de una uart
+ * @param uart	Identificador de la uart
+ * @param enable	1 para activarlo, 0 para desactivarlo
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_set_flow_control (uart_id_t uart, uint32_t enable)
+{
+	uint32_t state;
+
+	if (uart > uart_2) {
+		errno = ENODEV;
+		return -1;
+	}
+	/* Con un nivel de recepción mayor, la FIFO no llegaría a avisar a la cpu */
+	if (enable && uart_watermarks[uart].rx_level >= UART_CTS_LEVEL) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	uart_flow_control[uart] = enable ? 1 : 0;
+
+	/* La uart desactiva CTS cuando su FIFO de recepción alcanza el nivel.
+	La isr deja de vaciarla cuando el búfer circular se llena, así que es la
+	ocupación del búfer la que acaba deteniendo al otro extremo */
+	uart_regs[uart]->CTS_Level = UART_CTS_LEVEL;
+
+	/* FCp y FCe están en CON, que también modifican las isr */
+	state = excep_critical_enter ();
+	uart_regs[uart]->FCp = 0;			/* CTS y RTS activos a nivel bajo */
+	uart_regs[uart]->FCe = uart_flow_control[uart];
+	excep_critical_exit (state);
+
+	/* Sin control de flujo, basta con que haya hueco para reanudar */
+	uart_rx_resume (uart);
+
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Función de tick de las uart
+ * Detecta el silencio en la línea de recepción de las uart que agrupan
+ * interrupciones y fuerza a la isr a vaciar su FIFO
+ */
+static void uart_tick_hook (void)
+{
+	volatile uart_watermarks_t *wm;
+	uint32_t uart, count;
+
+	for (uart = 0; uart < uart_max; uart++) {
+		wm = & uart_watermarks[uart];
+		if (!wm->idle_ticks)
+			continue;
+
+		count = uart_regs[uart]->Rx_fifo_addr_diff;
+
+		if (wm->forced) {
+			/* El manejador FIQ no restablece el nivel: lo hacemos aquí */
+			if (count == 0) {
+				uart_regs[uart]->RxLevel = wm->rx_level;
+				wm->forced = 0;
+			}
+		}
+		else if (count == 0 || count != wm->last_count)
+			wm->idle_count = 0;
+		else if (++wm->idle_count >= wm->idle_ticks) {
+			/* Primero el flag, para que la isr sepa restablecer el nivel */
+			wm->forced = 1;
+			uart_regs[uart]->RxLevel = 1;
+			wm->idle_count = 0;
+		}
+		wm->last_count = count;
+	}
+}
+
+/*****************************************************************************/
+
+/**
+ * Obtiene las estadísticas de una uart
+ * @param uart	Identificador de la uart
+ * @param stats	Estructura donde copiar las estadísticas
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_get_stats (uart_id_t uart, uart_stats_t *stats)
+{
+	uint32_t state;
+
+	if (uart > uart_2) {
+		errno = ENODEV;
+		return -1;
+	}
+	if (stats == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+
+	/* El manejador FIQ no lee el estado, así que recogemos aquí los errores
+	pendientes. La isr también lo lee y actualiza los contadores */
+	state = excep_critical_enter ();
+	uart_account_status (uart, uart_regs[uart]->STAT);
+	*stats = uart_stats[uart];
+	excep_critical_exit (state);
+
+	stats->rx_bytes = uart_circular_rx_buffers[uart].end;
+	stats->tx_bytes = uart_circular_tx_buffers[uart].start;
+
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Descarta los datos pendientes de una uart
+ * @param uart	Identificador de la uart
+ * @param which	UART_FLUSH_RX, UART_FLUSH_TX o ambos
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_flush (uart_id_t uart, uint32_t which)
+{
+	volatile circular_buffer_t *cb;
+	uint32_t state;
+
+	if (uart > uart_2) {
+		errno = ENODEV;
+		return -1;
+	}
+	if (which & ~(UART_FLUSH_RX | UART_FLUSH_TX)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* Las isr escriben en el búfer de recepción y consumen del de transmisión,
+	así que los vaciamos sin que puedan ejecutarse */
+	state = excep_critical_enter ();
+
+	if (which & UART_FLUSH_RX) {
+		while (uart_regs[uart]->Rx_fifo_addr_diff)
+			(void) uart_regs[uart]->Rx_data;
+		cb = & uart_circular_rx_buffers[uart];
+		circular_buffer_consume (cb, circular_buffer_count (cb));
+	}
+	if (which & UART_FLUSH_TX) {
+		cb = & uart_circular_tx_buffers[uart];
+		circular_buffer_consume (cb, circular_buffer_count (cb));
+	}
+
+	excep_critical_exit (state);
+
+	/* Si la isr enmascaró la recepción por tener el búfer lleno, ya hay hueco */
+	if (which & UART_FLUSH_RX)
+		uart_rx_resume (uart);
+
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Función ioctl del dispositivo de una uart
+ * Traduce las órdenes UART_IOC_* a las funciones del driver
+ * @param id	Identificador de la uart
+ * @param request	Orden
+ * @param arg	Argumento de la orden
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+static int uart_ioctl (uint32_t id, uint32_t request, void *arg)
+{
+	uart_ioc_baudrate_t *baud = arg;
+	uart_ioc_watermarks_t *wm = arg;
+
+	if (arg == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+
+	switch (request) {
+	case UART_IOC_SET_BAUDRATE:
+		return uart_set_baudrate (id, baud->br, & baud->error_ppm);
+	case UART_IOC_GET_BAUDRATE:
+		*(uint32_t *) arg = uart_baudrates[id];
+		return 0;
+	case UART_IOC_SET_WATERMARKS:
+		return uart_set_watermarks (id, wm->rx_level, wm->tx_level, wm->rx_idle_bits);
+	case UART_IOC_SET_FLOW_CONTROL:
+		return uart_set_flow_control (id, *(uint32_t *) arg);
+	case UART_IOC_FLUSH:
+		return uart_flush (id, *(uint32_t *) arg);
+	case UART_IOC_GET_STATS:
+		return uart_get_stats (id, arg);
+	}
+
+	errno = ENOTTY;
+	return -1;
+}
+
+/*****************************************************************************/
+
+/**
+ * Función fstat del dispositivo de una uart
+ * Es un dispositivo de caracteres. st_size indica los bytes recibidos
+ * pendientes de leer y st_blksize el tamaño del búfer de recepción
+ * @param id	Identificador de la uart
+ * @param buf	Estructura stat a rellenar
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+static int uart_fstat (uint32_t id, struct stat *buf)
+{
+	if (buf == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+
+	memset (buf, 0, sizeof (struct stat));
+	buf->st_mode = S_IFCHR;
+	buf->st_rdev = id;
+	buf->st_size = circular_buffer_count (& uart_circular_rx_buffers[id]);
+	buf->st_blksize = uart_rx_buffer_sizes[id];
+
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Función poll del dispositivo de una uart
+ * Está lista para leer si hay bytes recibidos y para escribir si hay hueco en
+ * el búfer de transmisión
+ * @param id	Identificador de la uart
+ * @param events	Eventos solicitados
+ * @return	Los eventos listos
+ */
+static int uart_poll (uint32_t id, int events)
+{
+	int revents = 0;
+
+	if ((events & BSP_POLLIN) && !circular_buffer_is_empty (& uart_circular_rx_buffers[id]))
+		revents |= BSP_POLLIN;
+	if ((events & BSP_POLLOUT) && !circular_buffer_is_full (& uart_circular_tx_buffers[id]))
+		revents |= BSP_POLLOUT;
+
+	return revents;
+}
+
+/*****************************************************************************/
+
+/**
+ * Trabajo diferido que ejecuta la callback de recepción de una uart en modo usuario
+ * @param arg	Identificador de la uart
+ */
+static void uart_rx_callback_work (void *arg)
+{
+	uart_id_t uart = (uart_id_t) (uintptr_t) arg;
+	uart_callback_t func = uart_callbacks[uart].rx_callback;
+
+	/* Si llegan más datos mientras se ejecuta, la isr vuelve a encolarla */
+	uart_callbacks[uart].rx_pending = 0;
+	if (func)
+		func();
+}
+
+/*****************************************************************************/
+
+/**
+ * Trabajo diferido que ejecuta la callback de transmisión de una uart en modo usuario
+ * @param arg	Identificador de la uart
+ */
+static void uart_tx_callback_work (void *arg)
+{
+	uart_id_t uart = (uart_id_t) (uintptr_t) arg;
+	uart_callback_t func = uart_callbacks[uart].tx_callback;
+
+	uart_callbacks[uart].tx_pending = 0;
+	if (func)
+		func();
+}
+
+/*****************************************************************************/
+
 /**
  * Manejador genérico de interrupciones para las uart.
  * Cada isr llamará a este manejador indicando la uart en la que se ha
@@ -441,8 +1471,8 @@ int32_t uart_set_send_callback (uart_id_t uart, uart_callback_t func)
  */
 static inline void uart_isr (uart_id_t uart)
 {
-/* Limpiamos los bits de error, de momento no gestionamos errores */
-	uint32_t status = uart_regs[uart]->STAT;
+/* Leer el estado limpia los bits de error, que acumulamos en las estadísticas */
+	uart_account_status (uart, uart_regs[uart]->STAT);
 
 	if (uart_regs[uart]->RxRdy) {
 		/* Mientras podamos cargar datos en nuestra estructura
@@ -452,10 +1482,20 @@ static inline void uart_isr (uart_id_t uart)
 			circular_buffer_write(&uart_circular_rx_buffers[uart], uart_regs[uart]->Rx_data);
 		}
 
-		if (uart_callbacks[uart].rx_callback)
-			uart_callbacks[uart].rx_callback();
+		/*la callback se ejecutará en modo usuario*/
+		if (uart_callbacks[uart].rx_callback && !uart_callbacks[uart].rx_pending)
+			if (bsp_work_post (uart_rx_callback_work, (void *) (uintptr_t) uart) == 0)
+				uart_callbacks[uart].rx_pending = 1;
+		/*con el búfer lleno dejamos de vaciar la FIFO; con control de flujo,
+		al llenarse ésta se desactiva CTS y el otro extremo se detiene*/
 		if (circular_buffer_is_full(& uart_circular_rx_buffers[uart]))
 			uart_regs[uart]->mRxR = 1;
+
+		/*si la función de tick forzó el vaciado, volvemos a agrupar*/
+		if (uart_watermarks[uart].forced) {
+			uart_regs[uart]->RxLevel = uart_watermarks[uart].rx_level;
+			uart_watermarks[uart].forced = 0;
+		}
 	}
 
 	if (uart_regs[uart]->TxRdy) {
@@ -467,9 +1507,10 @@ static inline void uart_isr (uart_id_t uart)
 			/*lo escrito va directamente al buffer de envío (TX FIFO)*/
 			uart_regs[uart]->Tx_data = circular_buffer_read(&uart_circular_tx_buffers[uart]);
 
-		/*si se ha elegido controlador de envío, se le da el control*/
-		if (uart_callbacks[uart].tx_callback)
-			uart_callbacks[uart].tx_callback();
+		/*si se ha elegido controlador de envío, se le dará el control en modo usuario*/
+		if (uart_callbacks[uart].tx_callback && !uart_callbacks[uart].tx_pending)
+			if (bsp_work_post (uart_tx_callback_work, (void *) (uintptr_t) uart) == 0)
+				uart_callbacks[uart].tx_pending = 1;
 
 			/*si la estructura intermedia de envío está vacía
 			pedimos a la UART por favor que nos deje en paz a la hora de pedir cosas*/
@@ -477,8 +1518,8 @@ static inline void uart_isr (uart_id_t uart)
 			uart_regs[uart]->mTxR = 1;
 	}
 
-
-
+	/*hay datos nuevos o hueco libre: despertamos a quien espere en bsp_poll*/
+	bsp_poll_wakeup ();
 }
 
 /*****************************************************************************/
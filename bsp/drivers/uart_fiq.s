@@ -0,0 +1,141 @@
+@
+@ Sistemas Empotrados
+@ Manejador FIQ para las uart del MC1322x
+@
+@ Atiende a las uart configuradas en modo FIQ (ver uart_init). Vacía la FIFO
+@ de recepción en el búfer circular de recepción y llena la FIFO de transmisión
+@ desde el búfer circular de transmisión, sin pasar por la tabla de manejadores
+@ del ITC. Sólo usa los registros r8-r12, replicados en modo FIQ, por lo que no
+@ necesita guardar nada en la pila.
+@
+
+@
+@ Desplazamientos de los registros de la uart (uart_regs_t en uart.c)
+@
+	.set UART_CON,   0x00
+	.set UART_DATA,  0x08
+	.set UART_RXCON, 0x0C
+	.set UART_TXCON, 0x10
+
+	.set UART_MTXR, (1 << 13)	@ Máscara de la interrupción de transmisión
+	.set UART_MRXR, (1 << 14)	@ Máscara de la interrupción de recepción
+	.set UART_FIFO_ADDR_DIFF, 0x3F	@ Bytes en la FIFO de RX / huecos en la de TX
+
+@
+@ Desplazamientos de los campos de un búfer circular (circular_buffer_t)
+@
+	.set CB_DATA,  0
+	.set CB_SIZE,  4
+	.set CB_MASK,  8
+	.set CB_START, 12
+	.set CB_END,   16
+
+@
+@ Desplazamientos de los campos del contexto FIQ (uart_fiq_ctx_t en uart.c)
+@
+	.set CTX_REGS, 0
+	.set CTX_RX,   4
+	.set CTX_TX,   8
+	.set CTX_SIZE, 12
+
+	.code 32
+	.text
+
+@
+@ Vacía la FIFO de recepción en el búfer circular de recepción
+@ Entrada: r8 = registros de la uart, r9 = búfer de recepción
+@ Usa r10-r12. Somos el único productor del búfer, así que sólo escribimos end
+@
+	.macro uart_fiq_rx
+	ldr	r10, [r9, #CB_END]		@ r10 <- contador de escritura
+1:
+	ldr	r11, [r8, #UART_RXCON]
+	ands	r11, r11, #UART_FIFO_ADDR_DIFF
+	beq	3f				@ FIFO vacía
+	ldr	r11, [r9, #CB_START]
+	sub	r11, r10, r11			@ r11 <- bytes en el búfer
+	ldr	r12, [r9, #CB_SIZE]
+	cmp	r11, r12
+	beq	2f				@ Búfer lleno
+	ldr	r12, [r9, #CB_MASK]
+	and	r11, r10, r12
+	ldr	r12, [r9, #CB_DATA]
+	add	r12, r12, r11			@ r12 <- posición de escritura
+	ldr	r11, [r8, #UART_DATA]
+	strb	r11, [r12]
+	add	r10, r10, #1
+	b	1b
+2:
+	ldr	r11, [r8, #UART_CON]		@ Búfer lleno: enmascaramos la recepción
+	orr	r11, r11, #UART_MRXR		@ hasta que el consumidor haga hueco
+	str	r11, [r8, #UART_CON]
+3:
+	str	r10, [r9, #CB_END]		@ Publicamos los bytes recibidos
+	.endm
+
+@
+@ Llena la FIFO de transmisión desde el búfer circular de transmisión
+@ Entrada: r8 = registros de la uart, r9 = búfer de transmisión
+@ Usa r10-r12. Somos el único consumidor del búfer, así que sólo escribimos start
+@
+	.macro uart_fiq_tx
+	ldr	r11, [r8, #UART_CON]
+	tst	r11, #UART_MTXR
+	bne	4f				@ Transmisión enmascarada
+	ldr	r10, [r9, #CB_START]		@ r10 <- contador de lectura
+1:
+	ldr	r11, [r9, #CB_END]
+	cmp	r10, r11
+	beq	2f				@ Búfer vacío
+	ldr	r11, [r8, #UART_TXCON]
+	ands	r11, r11, #UART_FIFO_ADDR_DIFF
+	beq	3f				@ FIFO llena
+	ldr	r12, [r9, #CB_MASK]
+	and	r11, r10, r12
+	ldr	r12, [r9, #CB_DATA]
+	ldrb	r11, [r12, r11]
+	str	r11, [r8, #UART_DATA]
+	add	r10, r10, #1
+	b	1b
+2:
+	ldr	r11, [r8, #UART_CON]		@ Búfer vacío: enmascaramos la transmisión
+	orr	r11, r11, #UART_MTXR		@ hasta que el productor encole más datos
+	str	r11, [r8, #UART_CON]
+3:
+	str	r10, [r9, #CB_START]		@ Liberamos los bytes enviados
+4:
+	.endm
+
+@
+@ Atiende a una uart si está configurada en modo FIQ
+@ Entrada: n = índice de la uart en uart_fiq_ctx
+@
+	.macro uart_fiq_service n
+	ldr	r9, =uart_fiq_ctx + (\n * CTX_SIZE)
+	ldr	r8, [r9, #CTX_REGS]
+	cmp	r8, #0
+	beq	9f				@ La uart está en modo IRQ
+	ldr	r9, [r9, #CTX_RX]
+	uart_fiq_rx
+	ldr	r9, =uart_fiq_ctx + (\n * CTX_SIZE)
+	ldr	r9, [r9, #CTX_TX]
+	uart_fiq_tx
+9:
+	.endm
+
+@
+@ Manejador FIQ de las uart
+@
+	.global	uart_fiq_handler
+	.type	uart_fiq_handler, %function
+uart_fiq_handler:
+	uart_fiq_service 0		@ uart_1
+	uart_fiq_service 1		@ uart_2
+	ldr	r8, =bsp_poll_seq		@ Despertamos a quien espere en bsp_poll
+	ldr	r9, [r8]			@ (bsp_poll_wakeup en dev.c)
+	add	r9, r9, #1
+	str	r9, [r8]
+	subs	pc, lr, #4		@ Retornamos restaurando el cpsr
+
+	.size	uart_fiq_handler, .-uart_fiq_handler
+	.ltorg
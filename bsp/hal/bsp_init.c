@@ -17,21 +17,46 @@ static void bsp_excep_init( void )
 	/* Inicializamos los manejadores de excepción */
 	excep_init();
 
+	/* Contextos de newlib de las isr */
+	bsp_libc_init();
+
 	/* Inicializamos el controlador de interrupciones */
 	itc_init ();
 }
 
 /*****************************************************************************/
 
+/**
+ * Indica si falló la reserva de los bloques de tamaño fijo. Se avisa por el
+ * error estándar una vez redireccionado
+ */
+static uint32_t bsp_pool_failed = 0;
+
+/*****************************************************************************/
+
 /**
  * Inicializa los dispositivos del sistema.
  * Esta función se debe llamar después de  bsp_int_init().
  */
 static void bsp_sys_init( void )
 {
+	/* Inicialización del CRM */
+	crm_init();
+
+	/* Reserva de los bloques del asignador de tamaño fijo. Si no hay heap
+	 * suficiente, las clases que no se pudieron reservar quedan vacías */
+	if (bsp_pool_init() < 0)
+		bsp_pool_failed = 1;
+
 	/* Inicialización de las UARTs */
-	uart_init(UART1_ID, UART1_BAUDRATE, UART1_NAME);
-	uart_init(UART2_ID, UART2_BAUDRATE, UART2_NAME);
+	uart_init(UART1_ID, UART1_BAUDRATE, UART1_NAME, UART1_RX_MODE);
+	uart_init(UART2_ID, UART2_BAUDRATE, UART2_NAME, UART2_RX_MODE);
+
+	/* Inicialización del temporizador del sistema */
+	tmr_init(BSP_TICK_HZ, TMR_NAME);
+
+	/* Inicialización de los temporizadores software */
+	bsp_timer_init();
 }
 
 /*****************************************************************************/
@@ -75,6 +100,11 @@ void bsp_init (void)
 	 */
 	bsp_io_redirect(BSP_STDIN, BSP_STDOUT, BSP_STDERR);
 
+	if (bsp_pool_failed)
+	{
+		static const char msg[] = "bsp_init: sin memoria para bsp_pool\n";
+		write(STDERR_FILENO, msg, sizeof (msg) - 1);
+	}
 }
 
 /*****************************************************************************/
@@ -28,12 +28,25 @@ static bsp_dev_t bsp_dev_list[BSP_MAX_DEV] =
 				NULL,			/* Función write por defecto */
 				NULL,			/* Función lseek por defecto */
 				NULL,			/* Función fstat por defecto */
-				NULL			/* Función isatty por defecto */
+				NULL,			/* Función isatty por defecto */
+				NULL,			/* Función readv por defecto */
+				NULL,			/* Función writev por defecto */
+				NULL,			/* Función poll por defecto */
+				NULL			/* Función ioctl por defecto */
 		}
 		/* El resto del array se inicializa a cero */
 };
 
 
+/*****************************************************************************/
+
+/**
+ * Contador de avisos de las isr a bsp_poll. Sólo importa que cambie: quien
+ * espera en bsp_poll vuelve a mirar los descriptores cuando cambia. El
+ * manejador FIQ de las uart (uart_fiq.s) también lo incrementa
+ */
+volatile uint32_t bsp_poll_seq = 0;
+
 /*****************************************************************************/
 
 /**
@@ -43,6 +56,25 @@ static uint32_t bsp_next_dev = 1;
 
 /*****************************************************************************/
 
+/**
+ * Tabla hash de los nombres de los dispositivos, con direccionamiento abierto
+ * Tiene el doble de entradas que dispositivos, así que las búsquedas recorren
+ * muy pocas entradas. Guarda el hash de cada nombre para comparar las cadenas
+ * sólo cuando coincide. /dev/null se inserta en la primera búsqueda o registro
+ */
+#define BSP_DEV_HASH_SIZE	(2 * BSP_MAX_DEV)
+
+typedef struct
+{
+	uint32_t hash;
+	bsp_dev_t *dev;				/* NULL si la entrada está libre */
+} bsp_dev_hash_t;
+
+static bsp_dev_hash_t bsp_dev_hash[BSP_DEV_HASH_SIZE];
+static uint32_t bsp_dev_hash_ready = 0;
+
+/*****************************************************************************/
+
 /**
  * Lista de descriptores de fichero abiertos. Las primeras tres entradas se
  * reservan para E/S estándar, asignada por defecto a /dev/null.
@@ -59,6 +91,131 @@ static bsp_fd_t bsp_fd_list[BSP_MAX_FD] =
 
 /*****************************************************************************/
 
+/**
+ * Mapa de bits de los descriptores ocupados
+ * Un bit a 1 en bsp_fd_used indica un descriptor ocupado, y un bit a 1 en
+ * bsp_fd_full una palabra de bsp_fd_used completa. Así el primer descriptor
+ * libre se encuentra con dos búsquedas del primer bit a 0 en una palabra. Los
+ * descriptores de la E/S estándar siempre están ocupados
+ */
+#define BSP_FD_WORDS	((BSP_MAX_FD + 31) / 32)
+
+typedef char BSP_MAX_FD_must_be_at_most_1024 [(BSP_MAX_FD > 3 && BSP_FD_WORDS <= 32) ? 1 : -1];
+
+static uint32_t bsp_fd_used[BSP_FD_WORDS] = { 0x7 };
+static uint32_t bsp_fd_full = 0;
+
+/*****************************************************************************/
+
+/**
+ * Posición del bit menos significativo a 1 de una palabra no nula
+ * El ARM7TDMI no tiene la instrucción clz, así que se usa una secuencia de De
+ * Bruijn: al multiplicarla por el bit aislado, los cinco bits altos del
+ * producto son distintos para cada posición
+ * @param x	La palabra
+ * @return	La posición del bit (0-31)
+ */
+static inline uint32_t bsp_lowest_bit (uint32_t x)
+{
+	static const uint8_t debruijn_pos[32] =
+	{
+		0, 1, 28, 2, 29, 14, 24, 3, 30, 22, 20, 15, 25, 17, 4, 8,
+		31, 27, 13, 23, 21, 19, 16, 7, 26, 12, 18, 6, 11, 5, 10, 9
+	};
+
+	return debruijn_pos[((x & -x) * 0x077cb531u) >> 27];
+}
+
+/*****************************************************************************/
+
+/**
+ * Marca un descriptor como ocupado
+ * @param fd	El descriptor
+ */
+static inline void bsp_fd_take (uint32_t fd)
+{
+	bsp_fd_used[fd >> 5] |= 1u << (fd & 31);
+	if (bsp_fd_used[fd >> 5] == 0xffffffff)
+		bsp_fd_full |= 1u << (fd >> 5);
+}
+
+/*****************************************************************************/
+
+/**
+ * Hash FNV-1a de un nombre
+ * @param name	El nombre
+ * @return		El hash
+ */
+static uint32_t bsp_dev_name_hash (const char *name)
+{
+	uint32_t hash = 2166136261u;
+
+	while (*name)
+		hash = (hash ^ (uint8_t) *name++) * 16777619u;
+
+	return hash;
+}
+
+/*****************************************************************************/
+
+/**
+ * Busca la entrada de la tabla hash de un nombre
+ * @param name	El nombre
+ * @param hash	Su hash
+ * @return		La entrada del dispositivo o, si no está, la entrada libre
+ * 				donde insertarlo
+ */
+static bsp_dev_hash_t * bsp_dev_hash_lookup (const char *name, uint32_t hash)
+{
+	uint32_t i = hash % BSP_DEV_HASH_SIZE;
+
+	/* Siempre hay entradas libres, así que la búsqueda termina */
+	while (bsp_dev_hash[i].dev != NULL)
+	{
+		if (bsp_dev_hash[i].hash == hash && !strcmp (bsp_dev_hash[i].dev->name, name))
+			break;
+		if (++i == BSP_DEV_HASH_SIZE)
+			i = 0;
+	}
+
+	return & bsp_dev_hash[i];
+}
+
+/*****************************************************************************/
+
+/**
+ * Inserta un dispositivo en la tabla hash. Si ya hay otro con el mismo nombre,
+ * se mantiene el primero
+ * @param dev	El dispositivo
+ */
+static void bsp_dev_hash_add (bsp_dev_t *dev)
+{
+	uint32_t hash = bsp_dev_name_hash (dev->name);
+	bsp_dev_hash_t *entry = bsp_dev_hash_lookup (dev->name, hash);
+
+	if (entry->dev == NULL)
+	{
+		entry->hash = hash;
+		entry->dev = dev;
+	}
+}
+
+/*****************************************************************************/
+
+/**
+ * Inserta /dev/null en la tabla hash si no se ha hecho ya
+ */
+static inline void bsp_dev_hash_init (void)
+{
+	if (!bsp_dev_hash_ready)
+	{
+		bsp_dev_hash_ready = 1;
+		bsp_dev_hash_add (bsp_dev_list);
+	}
+}
+
+/*****************************************************************************/
+
 /**
  * Registro de un dispositivo en el sistema.
  * @param name		Nombre del dispositivo
@@ -70,6 +227,11 @@ static bsp_fd_t bsp_fd_list[BSP_MAX_FD] =
  * @param lseek		Función lseek del dispositivo
  * @param fstat		Función fsat del dispositivo
  * @param isatty	Función isatty del dispositivo
+ * @param readv		Función readv del dispositivo. Si es NULL se usa read
+ * @param writev	Función writev del dispositivo. Si es NULL se usa write
+ * @param poll		Función poll del dispositivo. Si es NULL el dispositivo
+ * 					siempre está listo
+ * @param ioctl		Función ioctl del dispositivo
  * @return 			El numero de dispositivo asignado o -1 en caso de error
  */
 int32_t bsp_register_dev (const char  *name,
@@ -80,7 +242,11 @@ int32_t bsp_register_dev (const char  *name,
 		ssize_t (*write)(uint32_t id, char *buf, size_t count),
 		off_t (*lseek)(uint32_t id, off_t offset, int whence),
 		int (*fstat)(uint32_t id, struct stat *buf),
-		int (*isatty)(uint32_t id))
+		int (*isatty)(uint32_t id),
+		ssize_t (*readv)(uint32_t id, const bsp_iovec_t *iov, int iovcnt),
+		ssize_t (*writev)(uint32_t id, const bsp_iovec_t *iov, int iovcnt),
+		int (*poll)(uint32_t id, int events),
+		int (*ioctl)(uint32_t id, uint32_t request, void *arg))
 {
 	int32_t index = -1;
 	if (bsp_next_dev < BSP_MAX_DEV)
@@ -97,6 +263,13 @@ int32_t bsp_register_dev (const char  *name,
 		bsp_dev_list[index].lseek = lseek;
 		bsp_dev_list[index].fstat = fstat;
 		bsp_dev_list[index].isatty = isatty;
+		bsp_dev_list[index].readv = readv;
+		bsp_dev_list[index].writev = writev;
+		bsp_dev_list[index].poll = poll;
+		bsp_dev_list[index].ioctl = ioctl;
+
+		bsp_dev_hash_init ();
+		bsp_dev_hash_add (& bsp_dev_list[index]);
 	}
 
 	return index;
@@ -110,15 +283,9 @@ int32_t bsp_register_dev (const char  *name,
  */
 bsp_dev_t * find_dev (const char *pathname)
 {
-	uint32_t i;
-	uint32_t len = strlen(pathname) + 1;
-
-	/* Usamos memcmp() en vez de strcmp() para reducir el tamaño del ejecutable */
-	for (i = 0 ; i < bsp_next_dev ; i++)
-		if (!memcmp (bsp_dev_list[i].name, pathname, len))
-			return &bsp_dev_list[i];
+	bsp_dev_hash_init ();
 
-	return NULL;
+	return bsp_dev_hash_lookup (pathname, bsp_dev_name_hash (pathname))->dev;
 }
 
 /*****************************************************************************/
@@ -129,6 +296,9 @@ bsp_dev_t * find_dev (const char *pathname)
  */
 inline bsp_dev_t* get_dev (uint32_t fd)
 {
+	if (fd >= BSP_MAX_FD)
+		return NULL;
+
 	return bsp_fd_list[fd].dev;
 }
 
@@ -145,6 +315,96 @@ inline int get_flags (uint32_t fd)
 
 /*****************************************************************************/
 
+/**
+ * Cambia los flags de apertura de un fichero
+ * @param fd	El descriptor
+ * @param flags	Los nuevos flags
+ */
+inline void set_flags (uint32_t fd, int flags)
+{
+	bsp_fd_list[fd].flags = flags;
+}
+
+/*****************************************************************************/
+
+/**
+ * Avisa a bsp_poll de que un dispositivo puede haber cambiado de estado
+ */
+inline void bsp_poll_wakeup (void)
+{
+	bsp_poll_seq++;
+}
+
+/*****************************************************************************/
+
+/**
+ * Espera a que alguno de los descriptores esté listo para leer o escribir
+ * @param fds		Descriptores y eventos a vigilar
+ * @param nfds		Número de descriptores
+ * @param timeout_ms	Tiempo máximo de espera en milisegundos, 0 para no
+ * 					esperar o negativo para esperar indefinidamente
+ * @return			El número de descriptores con eventos, 0 si venció el
+ * 					plazo o -1 en caso de error.
+ * 					La condición de error se indica en la variable global errno
+ */
+int bsp_poll (bsp_pollfd_t *fds, uint32_t nfds, int32_t timeout_ms)
+{
+	uint64_t end = 0;
+	uint32_t i, seq;
+	bsp_dev_t *dev;
+	int ready;
+
+	if (fds == NULL && nfds > 0)
+	{
+		errno = EFAULT;
+		return -1;
+	}
+
+	if (timeout_ms > 0)
+		end = bsp_time_us () + (uint64_t) timeout_ms * 1000;
+
+	while (1)
+	{
+		/* Si una isr avisa mientras miramos, no nos dormiremos */
+		seq = bsp_poll_seq;
+
+		ready = 0;
+		for (i = 0; i < nfds; i++)
+		{
+			fds[i].revents = 0;
+			if (fds[i].fd < 0)
+				continue;
+
+			if (fds[i].fd >= BSP_MAX_FD || (dev = bsp_fd_list[fds[i].fd].dev) == NULL)
+				fds[i].revents = BSP_POLLNVAL;
+			else if (dev->poll)
+				fds[i].revents = dev->poll (dev->id, fds[i].events) & fds[i].events;
+			else
+				fds[i].revents = fds[i].events & (BSP_POLLIN | BSP_POLLOUT);
+
+			if (fds[i].revents)
+				ready++;
+		}
+
+		if (ready || timeout_ms == 0)
+			return ready;
+
+		while (bsp_poll_seq == seq)
+		{
+			if (timeout_ms > 0 && bsp_time_us () >= end)
+				return 0;
+
+			/* Los trabajos diferidos de las isr se ejecutan antes de dormir.
+			 * Si alguno cambia el estado de un dispositivo, no se duerme */
+			bsp_run_pending ();
+			if (bsp_poll_seq == seq)
+				crm_wait_for_interrupt ();
+		}
+	}
+}
+
+/*****************************************************************************/
+
 /**
  * Asigna un nuevo descriptor de fichero a un dispositivo
  * @param dev	El dispositivo
@@ -154,22 +414,26 @@ inline int get_flags (uint32_t fd)
  */
 int32_t get_fd(bsp_dev_t *dev, int flags)
 {
-	int32_t i;
+	uint32_t word, fd;
 
-	for (i = 0; i < BSP_MAX_FD; i++)
+	/* Primera palabra con algún descriptor libre y primer descriptor libre */
+	if (~bsp_fd_full == 0 || (word = bsp_lowest_bit (~bsp_fd_full)) >= BSP_FD_WORDS)
+		fd = BSP_MAX_FD;
+	else
+		fd = (word << 5) + bsp_lowest_bit (~bsp_fd_used[word]);
+
+	/* Se ha alcanzado el máximo número de ficheros abiertos */
+	if (fd >= BSP_MAX_FD)
 	{
-		/* Si la entrada de la tabla está vacía, le asignamos un nuevo descriptor */
-		if (bsp_fd_list[i].dev == NULL)
-		{
-			bsp_fd_list[i].dev = dev;
-			bsp_fd_list[i].flags = flags;
-			return i;
-		}
+		errno = ENFILE;
+		return -1;
 	}
 
-	/* Se ha alcanzado el máximo número de ficheros abiertos */
-	errno = ENFILE;
-	return -1;
+	bsp_fd_take (fd);
+	bsp_fd_list[fd].dev = dev;
+	bsp_fd_list[fd].flags = flags;
+
+	return fd;
 }
 
 /*****************************************************************************/
@@ -181,10 +445,13 @@ int32_t get_fd(bsp_dev_t *dev, int flags)
  */
 void release_fd (uint32_t fd)
 {
-	if (fd > 2)
+	if (fd > 2 && fd < BSP_MAX_FD)
 	{
 		bsp_fd_list[fd].dev   = NULL;
 		bsp_fd_list[fd].flags = 0;
+
+		bsp_fd_used[fd >> 5] &= ~(1u << (fd & 31));
+		bsp_fd_full &= ~(1u << (fd >> 5));
 	}
 }
 
@@ -205,8 +472,9 @@ void redirect_fd(uint32_t fd, const char* name, int flags, mode_t mode)
 
 	temp = open (name, flags, mode);
 
-	if (temp >= 0)
+	if (temp >= 0 && fd < BSP_MAX_FD)
 	{
+		bsp_fd_take (fd);
 		bsp_fd_list[fd].dev   = bsp_fd_list[temp].dev;
 		bsp_fd_list[fd].flags = bsp_fd_list[temp].flags;
 
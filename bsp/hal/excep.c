@@ -19,7 +19,11 @@ extern volatile excep_handler_t _excep_handlers[excep_max];
  */
 void excep_init ()
 {
+#if EXCEP_NESTED_IRQ
+	excep_set_handler (excep_irq, excep_nested_irq_handler);
+#else
 	excep_set_handler (excep_irq, excep_nonnested_irq_handler);
+#endif
 }
 
 /*****************************************************************************/
@@ -141,8 +145,8 @@ inline void excep_restore_irq (uint32_t i_bit)
 {
 	/* ESTA FUNCIÓN SE DEFINIRÁ EN LA PRÁCTICA 5 */
 	asm volatile( "mrs r12, cpsr\n\t" 			     					/* r12 <- cpsr */
-								"bic r12, r12, #0x80\n\t"      					/* Limpiamos los bits I,F */
-								"orr r12, r12, %[b], LSL #6\n\t"			/* Restauramos los bits */
+								"bic r12, r12, #0x80\n\t"      					/* Limpiamos el bit I */
+								"orr r12, r12, %[b], LSL #7\n\t"			/* Restauramos el bit */
 								"msr cpsr_c, r12"
 						:																						/* Parámetros de salida */
 						:		[b] "r" (i_bit & 1)								/* Parámetros de entrada */
@@ -175,6 +179,78 @@ inline void excep_restore_fiq (uint32_t f_bit)
 
 /*****************************************************************************/
 
+/**
+ * Estado de excep_critical_enter para las secciones críticas en modo USER
+ * Los valores 0 a 3 son los bits I y F de los modos privilegiados
+ */
+#define EXCEP_CRITICAL_USR	4
+
+/**
+ * Anidamiento de las secciones críticas en modo USER
+ * Las isr no lo modifican, porque usan los bits I y F
+ */
+static uint32_t excep_critical_depth = 0;
+
+/*****************************************************************************/
+
+/**
+ * Comienzo de una sección crítica
+ * En los modos privilegiados deshabilita los bits I y F de la CPU; en modo
+ * USER deshabilita las interrupciones en el controlador de interrupciones
+ * @return	El estado que hay que pasar a excep_critical_exit
+ */
+inline uint32_t excep_critical_enter (void)
+{
+	uint32_t cpsr;
+
+	asm volatile ("mrs %[c], cpsr" : [c] "=r" (cpsr));
+
+	if ((cpsr & 0x1f) != 0x10)
+		return excep_disable_ints ();
+
+	/* itc_disable_ints guarda el estado anterior en una única variable, así
+	que sólo la llama la sección crítica más externa */
+	if (excep_critical_depth++ == 0)
+		itc_disable_ints ();
+
+	return EXCEP_CRITICAL_USR;
+}
+
+/*****************************************************************************/
+
+/**
+ * Fin de una sección crítica
+ * @param state	Estado retornado por el excep_critical_enter correspondiente
+ */
+inline void excep_critical_exit (uint32_t state)
+{
+	if (state != EXCEP_CRITICAL_USR)
+		excep_restore_ints (state);
+	else if (--excep_critical_depth == 0)
+		itc_restore_ints ();
+}
+
+/*****************************************************************************/
+
+/**
+ * Indica si la CPU puede atender ahora las IRQ
+ * @return	Cero si el bit I está activo o, en modo USER, si hay una sección
+ * 			crítica abierta
+ */
+inline uint32_t excep_irq_enabled (void)
+{
+	uint32_t cpsr;
+
+	asm volatile ("mrs %[c], cpsr" : [c] "=r" (cpsr));
+
+	if ((cpsr & 0x1f) == 0x10)
+		return excep_critical_depth == 0;
+
+	return !(cpsr & 0x80);
+}
+
+/*****************************************************************************/
+
 /**
  * Asigna un manejador de interrupción/excepción
  * @param excep		Tipo de excepción
@@ -0,0 +1,70 @@
+@
+@ Sistemas Empotrados
+@ Manejadores en ensamblador para las interrupciones normales (IRQ)
+@
+
+	.set _IRQ_DISABLE, 0x80 @ cuando el bit I está activo, IRQ está deshabilitado
+
+	.set _IRQ_MODE, 0x12
+	.set _SYS_MODE, 0x1F
+
+	.code 32
+	.text
+
+@
+@ Manejador para interrupciones normales no anidadas
+@ Guarda en la pila IRQ los registros que no preservan las funciones C y
+@ despacha la interrupción pendiente de más prioridad con las IRQ deshabilitadas
+@
+	.global	excep_nonnested_irq_handler_asm
+	.type	excep_nonnested_irq_handler_asm, %function
+excep_nonnested_irq_handler_asm:
+	sub	lr, lr, #4			@ Dirección de retorno
+	stmfd	sp!, {r0-r3, r12, lr}
+	bl	itc_service_normal_interrupt
+	ldmfd	sp!, {r0-r3, r12, pc}^		@ Retornamos restaurando el cpsr
+
+	.size	excep_nonnested_irq_handler_asm, .-excep_nonnested_irq_handler_asm
+
+@
+@ Manejador para interrupciones normales anidadas
+@ Guarda el contexto interrumpido (incluidos lr_irq y spsr_irq) en la pila del
+@ modo System y despacha la interrupción en ese modo. itc_service_nested_interrupt
+@ eleva NIMASK al nivel de la fuente servida y vuelve a habilitar las IRQ, de
+@ forma que sólo las fuentes de más prioridad pueden expulsar al manejador.
+@ La pila IRQ no se usa, así que su tamaño no depende del nivel de anidamiento
+@
+	.global	excep_nested_irq_handler
+	.type	excep_nested_irq_handler, %function
+excep_nested_irq_handler:
+	sub	lr, lr, #4			@ Dirección de retorno
+
+	@ Registros que no preservan las funciones C, en la pila de sistema
+	msr	cpsr_c, #(_SYS_MODE | _IRQ_DISABLE)
+	stmfd	sp!, {r0-r3, r12, lr}
+
+	@ lr_irq y spsr_irq, en la pila de sistema, ya que una IRQ anidada los
+	@ sobrescribirá
+	msr	cpsr_c, #(_IRQ_MODE | _IRQ_DISABLE)
+	mov	r0, lr
+	mrs	r1, spsr
+	msr	cpsr_c, #(_SYS_MODE | _IRQ_DISABLE)
+	stmfd	sp!, {r0, r1}
+
+	@ Servimos la IRQ. Retorna con las IRQ deshabilitadas
+	bl	itc_service_nested_interrupt
+
+	@ Restauramos lr_irq y spsr_irq
+	ldmfd	sp!, {r0, r1}
+	msr	cpsr_c, #(_IRQ_MODE | _IRQ_DISABLE)
+	mov	lr, r0
+	msr	spsr_cxsf, r1
+
+	@ Restauramos el resto del contexto interrumpido
+	msr	cpsr_c, #(_SYS_MODE | _IRQ_DISABLE)
+	ldmfd	sp!, {r0-r3, r12, lr}
+
+	msr	cpsr_c, #(_IRQ_MODE | _IRQ_DISABLE)
+	movs	pc, lr				@ Retornamos restaurando el cpsr
+
+	.size	excep_nested_irq_handler, .-excep_nested_irq_handler
@@ -0,0 +1,190 @@
+/*
+ * Sistemas operativos empotrados
+ * Soporte de la biblioteca de C (newlib): contextos de reentrada y cerrojos
+ *
+ * newlib guarda su estado (errno, los FILE de la E/S estándar, el estado de
+ * strtok, etc.) en el contexto al que apunta _impure_ptr. Las funciones
+ * reentrantes (_read_r, _write_r...) de newlib llaman a las de syscalls.c y
+ * dejan errno en ese contexto. Cada nivel de anidamiento de las isr, hasta
+ * BSP_ISR_REENT_LEVELS, tiene su propio contexto, así que una isr que usa stdio
+ * no corrompe los búferes de los FILE del código al que interrumpe. Más allá
+ * no se comparte el último contexto en silencio: la E/S falla con EAGAIN. Los FILE sí comparten el dispositivo: el
+ * búfer de transmisión de una uart sólo admite al código de usuario como
+ * productor, así que dentro de una isr _write falla con EAGAIN (bsp_in_isr)
+ *
+ * Las estructuras globales del heap y del entorno se protegen con cerrojos
+ * recursivos que deshabilitan las interrupciones (excep_critical_enter), ya
+ * que una isr no puede esperar a que el código interrumpido libere un cerrojo.
+ * malloc nunca se bloquea, así que las interrupciones sólo se retrasan durante
+ * la operación. Los FILE no se protegen así porque _write puede esperar a la
+ * isr de la uart
+ */
+
+#include <reent.h>
+#include "system.h"
+
+/*****************************************************************************/
+
+/**
+ * Cerrojo recursivo
+ * Mientras se posee, las interrupciones están deshabilitadas, así que nadie
+ * más puede consultarlo
+ */
+typedef struct
+{
+	uint32_t depth;				/* Número de veces que se ha cogido */
+	uint32_t state;				/* Estado de excep_critical_enter */
+} bsp_libc_lock_t;
+
+static bsp_libc_lock_t bsp_malloc_lock = {0, 0};
+static bsp_libc_lock_t bsp_env_lock = {0, 0};
+
+/*****************************************************************************/
+
+/**
+ * Contextos de newlib de las isr, uno por nivel de anidamiento
+ */
+static struct _reent bsp_isr_reent[BSP_ISR_REENT_LEVELS];
+
+/**
+ * Nivel de anidamiento de las isr y contexto interrumpido por cada nivel
+ */
+static uint32_t bsp_isr_depth = 0;
+static struct _reent *bsp_isr_saved[BSP_ISR_REENT_LEVELS];
+
+/*****************************************************************************/
+
+/**
+ * Coge un cerrojo recursivo
+ * @param lock	El cerrojo
+ */
+static inline void bsp_libc_lock (bsp_libc_lock_t *lock)
+{
+	/* Si ya lo tenemos, nadie nos puede interrumpir */
+	if (lock->depth == 0)
+		lock->state = excep_critical_enter ();
+	lock->depth++;
+}
+
+/*****************************************************************************/
+
+/**
+ * Suelta un cerrojo recursivo
+ * @param lock	El cerrojo
+ */
+static inline void bsp_libc_unlock (bsp_libc_lock_t *lock)
+{
+	if (--lock->depth == 0)
+		excep_critical_exit (lock->state);
+}
+
+/*****************************************************************************/
+
+/**
+ * Cerrojos que usa newlib para el heap (malloc, free, realloc...)
+ * @param reent	Contexto de newlib del llamante
+ */
+void __malloc_lock (struct _reent *reent)
+{
+	bsp_libc_lock (& bsp_malloc_lock);
+}
+
+void __malloc_unlock (struct _reent *reent)
+{
+	bsp_libc_unlock (& bsp_malloc_lock);
+}
+
+/*****************************************************************************/
+
+/**
+ * Cerrojos que usa newlib para las variables de entorno (getenv, setenv...)
+ * @param reent	Contexto de newlib del llamante
+ */
+void __env_lock (struct _reent *reent)
+{
+	bsp_libc_lock (& bsp_env_lock);
+}
+
+void __env_unlock (struct _reent *reent)
+{
+	bsp_libc_unlock (& bsp_env_lock);
+}
+
+/*****************************************************************************/
+
+/**
+ * Cambia el contexto de newlib (_impure_ptr) de la CPU
+ * @param reent	Nuevo contexto, inicializado con _REENT_INIT_PTR
+ * @return		El contexto anterior
+ */
+struct _reent * bsp_reent_switch (struct _reent *reent)
+{
+	struct _reent *old = _impure_ptr;
+
+	_impure_ptr = reent;
+
+	return old;
+}
+
+/*****************************************************************************/
+
+/**
+ * Inicializa los contextos de newlib de las isr
+ */
+void bsp_libc_init (void)
+{
+	uint32_t i;
+
+	for (i = 0; i < BSP_ISR_REENT_LEVELS; i++)
+		_REENT_INIT_PTR (& bsp_isr_reent[i]);
+}
+
+/*****************************************************************************/
+
+/**
+ * Entrada en una isr
+ */
+void bsp_isr_reent_enter (void)
+{
+	uint32_t level = bsp_isr_depth++;
+
+	if (level < BSP_ISR_REENT_LEVELS)
+		bsp_isr_saved[level] = bsp_reent_switch (& bsp_isr_reent[level]);
+}
+
+/*****************************************************************************/
+
+/**
+ * Salida de una isr
+ */
+void bsp_isr_reent_exit (void)
+{
+	uint32_t level = --bsp_isr_depth;
+
+	if (level < BSP_ISR_REENT_LEVELS)
+		bsp_reent_switch (bsp_isr_saved[level]);
+}
+
+/*****************************************************************************/
+
+/**
+ * Indica si el código se ejecuta dentro de una isr
+ * @return	Distinto de cero dentro de una isr servida por el ITC
+ */
+uint32_t bsp_in_isr (void)
+{
+	return bsp_isr_depth != 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Indica si la isr en curso no tiene su propio contexto de newlib
+ * @return	Distinto de cero si el anidamiento supera BSP_ISR_REENT_LEVELS
+ */
+uint32_t bsp_isr_reent_overflow (void)
+{
+	return bsp_isr_depth > BSP_ISR_REENT_LEVELS;
+}
+
+/*****************************************************************************/
@@ -0,0 +1,88 @@
+/*
+ * Sistemas operativos empotrados
+ * Uso de la memoria: pilas, heap y bloques de tamaño fijo
+ */
+
+#include <errno.h>
+#include "system.h"
+
+/*****************************************************************************/
+
+/**
+ * Patrón con el que crt0.s rellena las pilas (_STACK_FILLER)
+ */
+#define BSP_STACK_FILLER	0xdeadbeef
+
+/*****************************************************************************/
+
+/**
+ * Símbolos del script de enlazado
+ * Las pilas están contiguas, en el orden sys, svc, abt, und, irq, fiq
+ */
+extern uint32_t _stacks_bottom[];
+extern uint32_t _sys_stack_top[], _svc_stack_top[], _abt_stack_top[];
+extern uint32_t _und_stack_top[], _irq_stack_top[], _fiq_stack_top[];
+extern char _heap_start[], _heap_end[];
+
+/**
+ * Máximo alcanzado por el final del heap, en syscalls.c
+ */
+extern void *bsp_heap_peak;
+
+/**
+ * Ampliación del heap, en syscalls.c
+ */
+extern void * _sbrk (intptr_t incr);
+
+/*****************************************************************************/
+
+/**
+ * Límites de cada pila, indexados por bsp_stack_t
+ */
+static uint32_t * const bsp_stack_bottoms[bsp_stack_max] =
+		{_stacks_bottom, _und_stack_top, _irq_stack_top,
+		_sys_stack_top, _svc_stack_top, _abt_stack_top};
+static uint32_t * const bsp_stack_tops[bsp_stack_max] =
+		{_sys_stack_top, _irq_stack_top, _fiq_stack_top,
+		_svc_stack_top, _abt_stack_top, _und_stack_top};
+
+/*****************************************************************************/
+
+/**
+ * Obtiene el uso de la memoria
+ * @param stats	Estructura donde copiar el uso de la memoria
+ * @return		Cero en caso de éxito o -1 en caso de error.
+ * 				La condición de error se indica en la variable global errno
+ */
+int32_t bsp_mem_stats (bsp_mem_stats_t *stats)
+{
+	uint32_t *p;
+	uint32_t i;
+
+	if (stats == NULL)
+	{
+		errno = EFAULT;
+		return -1;
+	}
+
+	/* Las pilas crecen hacia abajo: buscamos la primera palabra alterada */
+	for (i = 0; i < bsp_stack_max; i++)
+	{
+		p = bsp_stack_bottoms[i];
+		while (p < bsp_stack_tops[i] && *p == BSP_STACK_FILLER)
+			p++;
+
+		stats->stacks[i].size = (char *) bsp_stack_tops[i] - (char *) bsp_stack_bottoms[i];
+		stats->stacks[i].peak = (char *) bsp_stack_tops[i] - (char *) p;
+	}
+
+	stats->heap_size = _heap_end - _heap_start;
+	stats->heap_used = (char *) _sbrk (0) - _heap_start;
+	stats->heap_peak = (char *) bsp_heap_peak - _heap_start;
+
+	bsp_pool_get_stats (stats->pools);
+
+	return 0;
+}
+
+/*****************************************************************************/
@@ -1,6 +1,7 @@
 #include <sys/types.h>
 #include <reent.h>
 #include <errno.h>
+#include <fcntl.h>
 
 #include "system.h"
 
@@ -11,6 +12,11 @@
  */
 extern void _heap_start, _heap_end;
 
+/**
+ * Máximo alcanzado por el final del heap. Lo consulta bsp_mem_stats
+ */
+void *bsp_heap_peak = &_heap_start;
+
 /*****************************************************************************/
 
 /**
@@ -25,10 +31,12 @@ void * _sbrk (intptr_t incr)
 {
 	static void *current_break = &_heap_start;
 	void *last_break = current_break;
+	uint32_t state;
 
 	/* Anulamos las interrupciones durante el proceso de reserva */
-	/* Comienzo de la sección crítica */
-	itc_disable_ints();
+	/* Comienzo de la sección crítica. Puede estar anidada en la de
+	__malloc_lock, así que no basta con itc_disable_ints */
+	state = excep_critical_enter ();
 
 	/* Forzamos a que el incremento sea un múltiplo del tamaño de la palabra */
 	incr = (intptr_t) (((unsigned int)incr + 3) & ~3);
@@ -43,11 +51,13 @@ void * _sbrk (intptr_t incr)
 	{
 		/* Ampliamos el área reservada para datos dinámicos */
 		current_break += incr;
+		if (current_break > bsp_heap_peak)
+			bsp_heap_peak = current_break;
 	}
 
 	/* Volvemos a habilitar las interrupciones */
 	/* Fin de la sección crítica */
-	itc_restore_ints();
+	excep_critical_exit (state);
 
 	return last_break;
 }
@@ -107,8 +117,59 @@ int _close (int fd)
 
 /*****************************************************************************/
 
+/**
+ * Espera a que un dispositivo progrese
+ * Los dispositivos avanzan en sus isr, así que basta con detener la CPU hasta
+ * la siguiente interrupción y volver a intentarlo. El trabajo diferido no se
+ * ejecuta aquí: sus callbacks podrían volver a llamar a stdio
+ */
+static inline void bsp_dev_wait (void)
+{
+	crm_wait_for_interrupt ();
+}
+
+/*****************************************************************************/
+
+/**
+ * Indica si una llamada sobre un descriptor no debe bloquearse
+ * Dentro de una isr nunca se bloquea: las interrupciones que harían progresar
+ * al dispositivo no se atienden hasta que termine, así que se comporta como
+ * con O_NONBLOCK
+ * @param fd	Descriptor de fichero/dispositivo
+ * @return		Distinto de cero si la llamada debe fallar con EAGAIN
+ */
+static inline int bsp_dev_nonblock (int fd)
+{
+	return (get_flags(fd) & O_NONBLOCK) || bsp_in_isr ();
+}
+
+/*****************************************************************************/
+
+/**
+ * Comprueba que la isr en curso, si la hay, tiene su propio contexto de newlib
+ * Si el anidamiento supera BSP_ISR_REENT_LEVELS, la isr está en el contexto de
+ * la que interrumpe y la E/S se rechaza (ver bsp_isr_reent_enter)
+ * @return		Cero si se puede hacer E/S o -1 en caso contrario (EAGAIN)
+ */
+static inline int bsp_dev_reent_check (void)
+{
+	if (bsp_isr_reent_overflow ())
+	{
+		errno = EAGAIN;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*****************************************************************************/
+
 /**
  * Lectura de un dispositivo/fichero
+ * Los dispositivos del BSP son de caracteres: una lectura que retorna 0 indica
+ * que todavía no hay datos. Sin O_NONBLOCK la llamada se bloquea hasta que
+ * llega al menos un byte; con O_NONBLOCK, o dentro de una isr, falla con
+ * EAGAIN. No debe llamarse en modo bloqueante con las IRQ deshabilitadas
  * @param fd	Descriptor de fichero/dispositivo
  * @param buf	Puntero al búfer donde se almacenarán los datos
  * @param count	Número de bytes que se quieren leer
@@ -118,16 +179,34 @@ int _close (int fd)
 ssize_t _read(int fd, char *buf, size_t count)
 {
 	bsp_dev_t *dev = get_dev(fd);
-	if (dev && dev->read)
-		return dev->read(dev->id, buf, count);
-	else
+	ssize_t n;
+
+	if (bsp_dev_reent_check () < 0)
+		return -1;
+	if (dev == NULL || dev->read == NULL || count == 0)
 		return 0;
+
+	while ((n = dev->read(dev->id, buf, count)) == 0)
+	{
+		if (bsp_dev_nonblock (fd))
+		{
+			errno = EAGAIN;
+			return -1;
+		}
+		bsp_dev_wait ();
+	}
+
+	return n;
 }
 
 /*****************************************************************************/
 
 /**
  * Escritura en un dispositivo/fichero
+ * Sin O_NONBLOCK la llamada se bloquea hasta escribir todos los bytes. Con
+ * O_NONBLOCK, o dentro de una isr, escribe los que puede y, si no puede
+ * escribir ninguno, falla con EAGAIN. No debe llamarse en modo bloqueante con
+ * las IRQ deshabilitadas
  * @param fd	Descriptor de fichero/dispositivo
  * @param buf	Puntero al búfer que almacena los datos
  * @param count	Número de bytes que se quieren escribir
@@ -137,14 +216,283 @@ ssize_t _read(int fd, char *buf, size_t count)
 ssize_t _write (int fd, char *buf, size_t count)
 {
 	bsp_dev_t *dev = get_dev(fd);
-	/*si tiene función write dicho dispositivo, mandamos los bytes
-	que haya escrito o -1 en caso de error*/
-	if (dev && dev->write)
-		return dev->write(dev->id, buf, count);
-	else
+	size_t done = 0;
+	ssize_t n;
+
+	if (bsp_dev_reent_check () < 0)
+		return -1;
+
+	/*sin función write, los bytes se descartan*/
+	if (dev == NULL || dev->write == NULL)
 		return count;
 
-	return count;
+	while (done < count)
+	{
+		n = dev->write(dev->id, buf + done, count - done);
+		if (n < 0)
+			return done ? done : -1;
+		done += n;
+
+		if (done < count && n == 0)
+		{
+			if (bsp_dev_nonblock (fd))
+				break;
+			bsp_dev_wait ();
+		}
+	}
+
+	if (done == 0 && count)
+	{
+		errno = EAGAIN;
+		return -1;
+	}
+
+	return done;
+}
+
+/*****************************************************************************/
+
+/**
+ * Lectura vectorizada de un dispositivo, sin bloqueo
+ * Si el dispositivo no tiene función readv, se llama a read para cada tramo
+ * hasta que uno no se completa
+ */
+static ssize_t bsp_dev_readv (bsp_dev_t *dev, const bsp_iovec_t *iov, int iovcnt)
+{
+	ssize_t total = 0, n;
+	int i;
+
+	if (dev->readv)
+		return dev->readv(dev->id, iov, iovcnt);
+
+	for (i = 0; i < iovcnt; i++) {
+		n = dev->read(dev->id, iov[i].iov_base, iov[i].iov_len);
+		if (n < 0)
+			return total ? total : -1;
+		total += n;
+		if ((size_t) n < iov[i].iov_len)
+			break;
+	}
+
+	return total;
+}
+
+/*****************************************************************************/
+
+/**
+ * Escritura vectorizada en un dispositivo, sin bloqueo
+ * Si el dispositivo no tiene función writev, se llama a write para cada tramo
+ * hasta que uno no se completa
+ */
+static ssize_t bsp_dev_writev (bsp_dev_t *dev, const bsp_iovec_t *iov, int iovcnt)
+{
+	ssize_t total = 0, n;
+	int i;
+
+	if (dev->writev)
+		return dev->writev(dev->id, iov, iovcnt);
+
+	for (i = 0; i < iovcnt; i++) {
+		n = dev->write(dev->id, iov[i].iov_base, iov[i].iov_len);
+		if (n < 0)
+			return total ? total : -1;
+		total += n;
+		if ((size_t) n < iov[i].iov_len)
+			break;
+	}
+
+	return total;
+}
+
+/*****************************************************************************/
+
+/**
+ * Lectura vectorizada de un dispositivo/fichero
+ * Como _read, se bloquea hasta que llega al menos un byte salvo con O_NONBLOCK
+ * o dentro de una isr
+ * @param fd		Descriptor de fichero/dispositivo
+ * @param iov		Tramos donde almacenar los datos
+ * @param iovcnt	Número de tramos
+ * @return			El número total de bytes leídos o -1 en caso de error.
+ * 					La condición de error se indica en la variable global errno
+ */
+ssize_t bsp_readv (int fd, const bsp_iovec_t *iov, int iovcnt)
+{
+	bsp_dev_t *dev = get_dev(fd);
+	ssize_t n;
+	int i;
+
+	if (iovcnt < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (iov == NULL && iovcnt > 0) {
+		errno = EFAULT;
+		return -1;
+	}
+	if (bsp_dev_reent_check () < 0)
+		return -1;
+	if (dev == NULL || (dev->read == NULL && dev->readv == NULL))
+		return 0;
+
+	/* Sin espacio en los tramos no hay nada que esperar */
+	for (i = 0; i < iovcnt && iov[i].iov_len == 0; i++)
+		;
+	if (i == iovcnt)
+		return 0;
+
+	while ((n = bsp_dev_readv (dev, iov, iovcnt)) == 0)
+	{
+		if (bsp_dev_nonblock (fd))
+		{
+			errno = EAGAIN;
+			return -1;
+		}
+		bsp_dev_wait ();
+	}
+
+	return n;
+}
+
+/*****************************************************************************/
+
+/**
+ * Escritura vectorizada en un dispositivo/fichero
+ * Como _write, se bloquea hasta escribir todos los tramos salvo con O_NONBLOCK
+ * o dentro de una isr
+ * @param fd		Descriptor de fichero/dispositivo
+ * @param iov		Tramos con los datos
+ * @param iovcnt	Número de tramos
+ * @return			El número total de bytes escritos o -1 en caso de error.
+ * 					La condición de error se indica en la variable global errno
+ */
+ssize_t bsp_writev (int fd, const bsp_iovec_t *iov, int iovcnt)
+{
+	bsp_dev_t *dev = get_dev(fd);
+	bsp_iovec_t rest;
+	size_t total = 0, len = 0, off = 0;
+	ssize_t n;
+	int i = 0;
+
+	if (iovcnt < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (iov == NULL && iovcnt > 0) {
+		errno = EFAULT;
+		return -1;
+	}
+	if (bsp_dev_reent_check () < 0)
+		return -1;
+
+	for (i = 0; i < iovcnt; i++)
+		len += iov[i].iov_len;
+
+	/*sin función write, los bytes se descartan*/
+	if (dev == NULL || (dev->write == NULL && dev->writev == NULL))
+		return len;
+
+	/* i es el primer tramo pendiente y off lo ya escrito de él */
+	i = 0;
+	while (total < len)
+	{
+		if (off)
+		{
+			rest.iov_base = (char *) iov[i].iov_base + off;
+			rest.iov_len = iov[i].iov_len - off;
+			n = bsp_dev_writev (dev, &rest, 1);
+		}
+		else
+			n = bsp_dev_writev (dev, iov + i, iovcnt - i);
+		if (n < 0)
+			return total ? total : -1;
+		total += n;
+
+		/* Avanzamos sobre los tramos completados */
+		off += n;
+		while (i < iovcnt && off >= iov[i].iov_len)
+		{
+			off -= iov[i].iov_len;
+			i++;
+		}
+
+		if (total < len && n == 0)
+		{
+			if (bsp_dev_nonblock (fd))
+				break;
+			bsp_dev_wait ();
+		}
+	}
+
+	if (total == 0 && len)
+	{
+		errno = EAGAIN;
+		return -1;
+	}
+
+	return total;
+}
+
+/*****************************************************************************/
+
+/**
+ * Control de un descriptor de fichero
+ * Permite consultar los flags de apertura (F_GETFL) y activar o desactivar
+ * O_NONBLOCK (F_SETFL). El resto de flags no se puede modificar
+ * @param fd	Descriptor de fichero/dispositivo
+ * @param cmd	Operación
+ * @param arg	Nuevos flags para F_SETFL
+ * @return		Los flags para F_GETFL, 0 para F_SETFL o -1 en caso de error.
+ * 				La condición de error se indica en la variable global errno
+ */
+int _fcntl (int fd, int cmd, int arg)
+{
+	if (get_dev(fd) == NULL)
+	{
+		errno = EBADF;
+		return -1;
+	}
+
+	switch (cmd)
+	{
+	case F_GETFL:
+		return get_flags(fd);
+	case F_SETFL:
+		set_flags(fd, (get_flags(fd) & ~O_NONBLOCK) | (arg & O_NONBLOCK));
+		return 0;
+	default:
+		errno = EINVAL;
+		return -1;
+	}
+}
+
+/*****************************************************************************/
+
+/**
+ * Configuración o consulta de un dispositivo/fichero
+ * @param fd		Descriptor de fichero/dispositivo
+ * @param request	Orden
+ * @param arg		Argumento de la orden
+ * @return			Un valor que depende de la orden o -1 en caso de error.
+ * 					La condición de error se indica en la variable global errno
+ */
+int _ioctl (int fd, uint32_t request, void *arg)
+{
+	bsp_dev_t *dev = get_dev(fd);
+
+	if (dev == NULL)
+	{
+		errno = EBADF;
+		return -1;
+	}
+	/* El dispositivo no admite órdenes */
+	if (dev->ioctl == NULL)
+	{
+		errno = ENOTTY;
+		return -1;
+	}
+
+	return dev->ioctl(dev->id, request, arg);
 }
 
 /*****************************************************************************/
@@ -10,25 +10,60 @@
 
 /*****************************************************************************/
 
+/**
+ * Comprueba en tiempo de compilación que el tamaño de un búfer circular es una
+ * potencia de dos. Si no lo es, el array tiene tamaño negativo y la
+ * compilación falla
+ * @param name	Nombre con el que identificar el búfer en el mensaje de error
+ * @param size	Tamaño en bytes del búfer
+ */
+#define CIRCULAR_BUFFER_CHECK_SIZE(name, size) \
+	typedef char name##_size_must_be_power_of_two [((size) != 0 && ((size) & ((size) - 1)) == 0) ? 1 : -1]
+
+/*****************************************************************************/
+
 /**
  * Estructura para gestionar un búfer circular
+ * El búfer es de tipo productor único/consumidor único (SPSC): el productor
+ * sólo modifica end y el consumidor sólo modifica start, por lo que una ISR y
+ * el código de usuario pueden compartirlo sin regiones críticas.
+ * El tamaño debe ser una potencia de dos. Los índices son contadores libres
+ * que sólo se incrementan; la posición en memoria se obtiene con la máscara
+ * size - 1 y el número de bytes almacenados es end - start, así que no hace
+ * falta ninguna comparación para dar la vuelta y se aprovecha todo el búfer.
+ * El manejador FIQ de las uart (uart_fiq.s) accede a estos campos por su
+ * desplazamiento, por lo que no debe alterarse su orden.
  */
 typedef struct
 {
 	uint8_t *data;
 	uint32_t size;
-	uint32_t start;
-	uint32_t end;
-	uint32_t count;
+	uint32_t mask;		/* size - 1 */
+	uint32_t start;		/* Contador de lectura. Sólo lo modifica el consumidor */
+	uint32_t end;		/* Contador de escritura. Sólo lo modifica el productor */
 } circular_buffer_t;
 
 /*****************************************************************************/
 
+/**
+ * Tramo contiguo de memoria dentro de un búfer circular
+ * Los datos almacenados (o el espacio libre) de un búfer circular ocupan como
+ * mucho dos tramos: uno hasta el final de la zona de memoria y otro desde su
+ * principio
+ */
+typedef struct
+{
+	uint8_t *data;
+	uint32_t len;
+} circular_buffer_span_t;
+
+/*****************************************************************************/
+
 /**
  * Inicializa un búfer circular dado un puntero a una zona de memoria y su tamaño
  * @param cb	Puntero a la estructura de gestión del búfer circular
  * @param addr	Puntero a la zona de memoria que se gestionará como un búfer circular
- * @param size	Tamaño en bytes del búfer
+ * @param size	Tamaño en bytes del búfer. Debe ser una potencia de dos
  */
 void circular_buffer_init (volatile circular_buffer_t *cb, uint8_t *addr, uint32_t size);
 
@@ -50,6 +85,14 @@ inline uint32_t circular_buffer_is_empty (volatile circular_buffer_t *cb);
 
 /*****************************************************************************/
 
+/**
+ * Retorna el número de bytes almacenados en el búfer
+ * @param cb	Búfer circular
+ */
+inline uint32_t circular_buffer_count (volatile circular_buffer_t *cb);
+
+/*****************************************************************************/
+
 /**
  * Escribe un byte en un búfer circular
  * @param cb	Búfer circular
@@ -71,4 +114,80 @@ int32_t circular_buffer_read (volatile circular_buffer_t *cb);
 
 /*****************************************************************************/
 
+/**
+ * Escribe un bloque de bytes en un búfer circular
+ * La copia se hace con memcpy en, como mucho, dos tramos contiguos
+ * @param cb	Búfer circular
+ * @param src	Puntero a los bytes a escribir
+ * @param len	Número de bytes a escribir
+ * @return		El número de bytes escritos, que puede ser menor que len si
+ * 				no hay espacio suficiente
+ */
+uint32_t circular_buffer_write_block (volatile circular_buffer_t *cb, const uint8_t *src, uint32_t len);
+
+/*****************************************************************************/
+
+/**
+ * Lee un bloque de bytes de un búfer circular
+ * La copia se hace con memcpy en, como mucho, dos tramos contiguos
+ * @param cb	Búfer circular
+ * @param dst	Puntero a la zona donde se almacenarán los bytes
+ * @param len	Número máximo de bytes a leer
+ * @return		El número de bytes leídos, que puede ser menor que len si
+ * 				el búfer no tiene tantos
+ */
+uint32_t circular_buffer_read_block (volatile circular_buffer_t *cb, uint8_t *dst, uint32_t len);
+
+/*****************************************************************************/
+
+/**
+ * Consulta los bytes almacenados en un búfer circular sin extraerlos
+ * Sólo debe llamarla el consumidor del búfer
+ * @param cb	Búfer circular
+ * @param spans	Los dos tramos con los bytes almacenados, en orden. El segundo
+ * 				tramo tiene longitud cero si los datos no dan la vuelta
+ * @return		El número total de bytes almacenados
+ */
+uint32_t circular_buffer_peek (volatile circular_buffer_t *cb, circular_buffer_span_t spans[2]);
+
+/*****************************************************************************/
+
+/**
+ * Extrae bytes de un búfer circular previamente consultados con
+ * circular_buffer_peek
+ * Sólo debe llamarla el consumidor del búfer
+ * @param cb	Búfer circular
+ * @param len	Número de bytes a extraer
+ * @return		El número de bytes extraídos, que puede ser menor que len si
+ * 				el búfer no tiene tantos
+ */
+uint32_t circular_buffer_consume (volatile circular_buffer_t *cb, uint32_t len);
+
+/*****************************************************************************/
+
+/**
+ * Reserva el espacio libre de un búfer circular para escribir en él directamente
+ * Sólo debe llamarla el productor del búfer
+ * @param cb	Búfer circular
+ * @param spans	Los dos tramos de espacio libre, en orden. El segundo tramo
+ * 				tiene longitud cero si el espacio libre no da la vuelta
+ * @return		El número total de bytes libres
+ */
+uint32_t circular_buffer_reserve (volatile circular_buffer_t *cb, circular_buffer_span_t spans[2]);
+
+/*****************************************************************************/
+
+/**
+ * Publica bytes escritos directamente en el espacio obtenido con
+ * circular_buffer_reserve
+ * Sólo debe llamarla el productor del búfer
+ * @param cb	Búfer circular
+ * @param len	Número de bytes escritos
+ * @return		El número de bytes publicados, que puede ser menor que len
+ * 				si no había tanto espacio libre
+ */
+uint32_t circular_buffer_commit (volatile circular_buffer_t *cb, uint32_t len);
+
+/*****************************************************************************/
+
 #endif /* __CIRCULAR_BUFFER_H__ */
@@ -0,0 +1,32 @@
+/*
+ * Sistemas operativos empotrados
+ * Driver para el módulo de control de reloj y reset (CRM) del MC1322x
+ */
+
+#ifndef __CRM_H__
+#define __CRM_H__
+
+#include <stdint.h>
+
+/*****************************************************************************/
+
+/**
+ * Inicializa el CRM
+ * Instala el manejador de las interrupciones del CRM, que reconoce los eventos
+ * de despertar pendientes
+ */
+void crm_init (void);
+
+/*****************************************************************************/
+
+/**
+ * Detiene el reloj de la CPU hasta la siguiente interrupción (IRQ o FIQ)
+ * Se usa para esperar sin consumir energía en lugar de hacer encuesta sobre
+ * los registros de los periféricos. Como el tick del sistema genera una
+ * interrupción periódica, la espera nunca es más larga que un tick
+ */
+inline void crm_wait_for_interrupt (void);
+
+/*****************************************************************************/
+
+#endif /* __CRM_H__ */
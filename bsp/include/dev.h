@@ -2,11 +2,43 @@
 #ifndef __DEV_H__
 #define __DEV_H__
 
+#include <stddef.h>
+#include <sys/types.h>
 #include <sys/stat.h>
 #include "system.h"
 
 /*****************************************************************************/
 
+/**
+ * Tramo de memoria para la E/S vectorizada (readv y writev)
+ */
+typedef struct
+{
+	void *iov_base;		/* Dirección del tramo */
+	size_t iov_len;		/* Tamaño del tramo en bytes */
+} bsp_iovec_t;
+
+/*****************************************************************************/
+
+/**
+ * Eventos de bsp_poll. Los valores coinciden con los de poll() de POSIX
+ */
+#define BSP_POLLIN		0x0001		/* Hay datos para leer */
+#define BSP_POLLOUT		0x0004		/* Se puede escribir sin bloquearse */
+#define BSP_POLLNVAL	0x0020		/* El descriptor no está abierto */
+
+/**
+ * Descriptor vigilado por bsp_poll
+ */
+typedef struct
+{
+	int fd;				/* Descriptor de fichero. Si es negativo se ignora */
+	short events;		/* Eventos solicitados */
+	short revents;		/* Eventos ocurridos */
+} bsp_pollfd_t;
+
+/*****************************************************************************/
+
 /**
  * Estructura para almacenar las funciones de gestión de cada dispositivo
  */
@@ -24,6 +56,12 @@ typedef struct
 	off_t (*lseek)(uint32_t id, off_t offset, int whence);	/* Función lseek */
 	int (*fstat)(uint32_t id, struct stat *buf);			/* Función fstat */
 	int (*isatty)(uint32_t id);								/* Función isatty */
+	ssize_t (*readv)(uint32_t id, const bsp_iovec_t *iov, int iovcnt);	/* Función readv */
+	ssize_t (*writev)(uint32_t id, const bsp_iovec_t *iov, int iovcnt);	/* Función writev */
+	int (*poll)(uint32_t id, int events);					/* Función poll. Retorna los */
+															/* eventos listos de entre */
+															/* los solicitados */
+	int (*ioctl)(uint32_t id, uint32_t request, void *arg);	/* Función ioctl */
 } bsp_dev_t;
 
 /*****************************************************************************/
@@ -50,6 +88,11 @@ typedef struct
  * @param lseek		Función lseek del dispositivo
  * @param fstat		Función fsat del dispositivo
  * @param isatty	Función isatty del dispositivo
+ * @param readv		Función readv del dispositivo. Si es NULL se usa read
+ * @param writev	Función writev del dispositivo. Si es NULL se usa write
+ * @param poll		Función poll del dispositivo. Si es NULL el dispositivo
+ * 					siempre está listo
+ * @param ioctl		Función ioctl del dispositivo
  * @return 			El numero de dispositivo asignado o -1 en caso de error
  */
 int32_t bsp_register_dev (const char  *name,
@@ -60,13 +103,20 @@ int32_t bsp_register_dev (const char  *name,
 		ssize_t (*write)(uint32_t id, char *buf, size_t count),
 		off_t (*lseek)(uint32_t id, off_t offset, int whence),
 		int (*fstat)(uint32_t id, struct stat *buf),
-		int (*isatty)(uint32_t id));
+		int (*isatty)(uint32_t id),
+		ssize_t (*readv)(uint32_t id, const bsp_iovec_t *iov, int iovcnt),
+		ssize_t (*writev)(uint32_t id, const bsp_iovec_t *iov, int iovcnt),
+		int (*poll)(uint32_t id, int events),
+		int (*ioctl)(uint32_t id, uint32_t request, void *arg));
 
 /*****************************************************************************/
 
 /**
  * Busca un dispositivo en el sistema
+ * Los nombres se buscan en una tabla hash, así que el coste no depende del
+ * número de dispositivos registrados
  * @param pathname   Nombre del dispositivo
+ * @return			El dispositivo o NULL si no está registrado
  */
 bsp_dev_t * find_dev (const char *pathname);
 
@@ -88,8 +138,18 @@ inline int get_flags (uint32_t fd);
 
 /*****************************************************************************/
 
+/**
+ * Cambia los flags de apertura de un fichero
+ * @param fd	El descriptor
+ * @param flags	Los nuevos flags
+ */
+inline void set_flags (uint32_t fd, int flags);
+
+/*****************************************************************************/
+
 /**
  * Asigna un nuevo descriptor de fichero a un dispositivo
+ * Se asigna el menor descriptor libre, con un coste constante
  * @param dev	El dispositivo
  * @param flags	Modo de acceso seleccionado en su apertura
  * @return 		El numero de descriptor o -1 en caso de error. La condición de error
@@ -121,4 +181,75 @@ void redirect_fd(uint32_t fd, const char* name, int flags, mode_t mode);
 
 /*****************************************************************************/
 
+/**
+ * Lectura vectorizada de un dispositivo/fichero
+ * Reparte los bytes leídos entre los tramos, en orden, con una sola llamada
+ * al dispositivo. Como read, se bloquea hasta que llega al menos un byte
+ * salvo que el fichero se abriera con O_NONBLOCK
+ * @param fd		Descriptor de fichero/dispositivo
+ * @param iov		Tramos donde almacenar los datos
+ * @param iovcnt	Número de tramos
+ * @return			El número total de bytes leídos o -1 en caso de error.
+ * 					La condición de error se indica en la variable global errno
+ */
+ssize_t bsp_readv (int fd, const bsp_iovec_t *iov, int iovcnt);
+
+/*****************************************************************************/
+
+/**
+ * Escritura vectorizada en un dispositivo/fichero
+ * Escribe los tramos, en orden, con una sola llamada al dispositivo, sin
+ * copiarlos antes a un búfer intermedio. Como write, se bloquea hasta
+ * escribirlos todos salvo que el fichero se abriera con O_NONBLOCK
+ * @param fd		Descriptor de fichero/dispositivo
+ * @param iov		Tramos con los datos
+ * @param iovcnt	Número de tramos
+ * @return			El número total de bytes escritos o -1 en caso de error.
+ * 					La condición de error se indica en la variable global errno
+ */
+ssize_t bsp_writev (int fd, const bsp_iovec_t *iov, int iovcnt);
+
+/*****************************************************************************/
+
+/**
+ * Configuración o consulta de un dispositivo/fichero
+ * Las órdenes y sus argumentos dependen de cada dispositivo (por ejemplo,
+ * UART_IOC_* en "uart.h")
+ * @param fd		Descriptor de fichero/dispositivo
+ * @param request	Orden
+ * @param arg		Argumento de la orden
+ * @return			Un valor que depende de la orden o -1 en caso de error.
+ * 					La condición de error se indica en la variable global errno
+ */
+int _ioctl (int fd, uint32_t request, void *arg);
+
+/*****************************************************************************/
+
+/**
+ * Avisa a bsp_poll de que un dispositivo puede haber cambiado de estado
+ * La llaman las isr de los dispositivos cuando reciben datos o liberan
+ * espacio, para despertar a quien espera en bsp_poll
+ */
+inline void bsp_poll_wakeup (void);
+
+/*****************************************************************************/
+
+/**
+ * Espera a que alguno de los descriptores esté listo para leer o escribir
+ * Mientras ninguno lo está, la CPU se detiene hasta que la isr de algún
+ * dispositivo llama a bsp_poll_wakeup o vence el plazo. Antes de cada espera
+ * ejecuta los trabajos diferidos (bsp_run_pending), por lo que puede servir
+ * como bucle de eventos. No debe llamarse con las IRQ deshabilitadas
+ * @param fds		Descriptores y eventos a vigilar
+ * @param nfds		Número de descriptores
+ * @param timeout_ms	Tiempo máximo de espera en milisegundos, 0 para no
+ * 					esperar o negativo para esperar indefinidamente
+ * @return			El número de descriptores con eventos, 0 si venció el
+ * 					plazo o -1 en caso de error.
+ * 					La condición de error se indica en la variable global errno
+ */
+int bsp_poll (bsp_pollfd_t *fds, uint32_t nfds, int32_t timeout_ms);
+
+/*****************************************************************************/
+
 #endif /* __DEV_H__ */
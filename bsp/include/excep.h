@@ -118,6 +118,36 @@ inline void excep_restore_fiq (uint32_t f_bit);
 
 /*****************************************************************************/
 
+/**
+ * Comienzo de una sección crítica
+ * A diferencia de excep_disable_ints, funciona en todos los modos. En los
+ * modos privilegiados deshabilita los bits I y F de la CPU; en modo USER, donde
+ * no se pueden alterar, deshabilita las interrupciones en el controlador de
+ * interrupciones. Las secciones críticas pueden anidarse
+ * @return	El estado que hay que pasar a excep_critical_exit
+ */
+inline uint32_t excep_critical_enter (void);
+
+/*****************************************************************************/
+
+/**
+ * Fin de una sección crítica
+ * @param state	Estado retornado por el excep_critical_enter correspondiente
+ */
+inline void excep_critical_exit (uint32_t state);
+
+/*****************************************************************************/
+
+/**
+ * Indica si la CPU puede atender ahora las IRQ
+ * Funciona en todos los modos, teniendo en cuenta las secciones críticas de
+ * modo USER
+ * @return	Cero si las IRQ están deshabilitadas
+ */
+inline uint32_t excep_irq_enabled (void);
+
+/*****************************************************************************/
+
 /**
  * Asigna un manejador de interrupción/excepción
  * @param excep		Tipo de excepción
@@ -148,6 +178,7 @@ void excep_nonnested_irq_handler ();
 
 /**
  * Manejador en ensamblador para interrupciones normales no anidadas
+ * Guarda el contexto en la pila IRQ y llama a itc_service_normal_interrupt
  */
 void excep_nonnested_irq_handler_asm ();
 
@@ -155,6 +186,9 @@ void excep_nonnested_irq_handler_asm ();
 
 /**
  * Manejador en ensamblador para interrupciones normales anidadas
+ * Guarda el contexto, incluidos spsr y lr del modo IRQ, en la pila del modo
+ * System y llama a itc_service_nested_interrupt en ese modo, que permite que las
+ * fuentes de más prioridad expulsen al manejador en curso
  */
 void excep_nested_irq_handler ();
 
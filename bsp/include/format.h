@@ -0,0 +1,124 @@
+/*
+ * Sistemas operativos empotrados
+ * Formateo de texto ligero (bsp_printf), sin la E/S estándar de newlib
+ */
+
+#ifndef __FORMAT_H__
+#define __FORMAT_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include "uart.h"
+
+/*****************************************************************************/
+
+/**
+ * Comprobación de las cadenas de formato al compilar
+ * gcc comprueba los argumentos con las reglas de printf, que admite más
+ * conversiones que bsp_printf, así que no avisa de las que no existen aquí. Las
+ * de coma flotante (e, f, g, a, también con L) y la conversión n se escriben
+ * tal cual, pero consumen su argumento, así que no desplazan los siguientes
+ */
+#define BSP_PRINTF_CHECK(fmt, args) __attribute__ ((format (printf, fmt, args)))
+
+/*****************************************************************************/
+
+/**
+ * Números en coma fija
+ * No hay formatos de coma flotante. Un valor v con q bits fraccionarios
+ * (q <= 16) se escribe con d decimales (d <= 4), truncados, con el formato
+ * BSP_FIXED_FMT(d) y los argumentos BSP_FIXED_ARGS(v, q, d). Por ejemplo:
+ *
+ *	bsp_printf ("t = " BSP_FIXED_FMT(2) " C\r\n", BSP_FIXED_ARGS(t, 8, 2));
+ *
+ * El valor se evalúa varias veces, así que no debe tener efectos laterales
+ */
+#define BSP_FIXED_FMT(d)	"%s%lu.%0" #d "lu"
+
+#define BSP_FIXED_ARGS(v, q, d) \
+	((int32_t) (v) < 0 ? "-" : ""), \
+	(unsigned long) (BSP_FIXED_ABS (v) >> (q)), \
+	(unsigned long) (((BSP_FIXED_ABS (v) & ((1u << (q)) - 1)) * BSP_FIXED_SCALE_##d) >> (q))
+
+#define BSP_FIXED_ABS(v) \
+	((int32_t) (v) < 0 ? -(uint32_t) (int32_t) (v) : (uint32_t) (int32_t) (v))
+#define BSP_FIXED_SCALE_0	1u
+#define BSP_FIXED_SCALE_1	10u
+#define BSP_FIXED_SCALE_2	100u
+#define BSP_FIXED_SCALE_3	1000u
+#define BSP_FIXED_SCALE_4	10000u
+
+/*****************************************************************************/
+
+/**
+ * Escribe texto con formato en la uart de bsp_printf (BSP_PRINTF_UART)
+ * Admite las conversiones d, i, u, x, X, o, c, s, p y %, los indicadores -, 0,
+ * +, espacio y # (sólo para x, X y o), el ancho y la precisión (también con *)
+ * y los modificadores de longitud hh, h, l, ll, z, t y j. No hay conversiones
+ * de coma flotante (ver BSP_FIXED_FMT y BSP_PRINTF_CHECK). El texto se genera
+ * directamente en el búfer de transmisión de la uart, sin pasar por los FILE
+ * de newlib, y la transmisión se desenmascara una sola vez. Si el búfer se
+ * llena, la CPU se detiene hasta que la isr le hace hueco. Con las IRQ
+ * deshabilitadas no se puede esperar, así que la salida se trunca a lo que
+ * cabe. Como uart_send, dentro de una isr falla con EAGAIN
+ * @param fmt	Cadena de formato
+ * @return		El número de caracteres enviados o -1 en caso de error.
+ * 				La condición de error se indica en la variable global errno
+ */
+int bsp_printf (const char *fmt, ...) BSP_PRINTF_CHECK (1, 2);
+
+/*****************************************************************************/
+
+/**
+ * Escribe texto con formato en una uart
+ * Como bsp_printf, pero en la uart indicada
+ * @param uart	Identificador de la uart
+ * @param fmt	Cadena de formato
+ * @return		El número de caracteres escritos o -1 en caso de error.
+ * 				La condición de error se indica en la variable global errno
+ */
+int bsp_uart_printf (uart_id_t uart, const char *fmt, ...) BSP_PRINTF_CHECK (2, 3);
+
+/*****************************************************************************/
+
+/**
+ * Escribe texto con formato en una uart, con los argumentos en una va_list
+ * @param uart	Identificador de la uart
+ * @param fmt	Cadena de formato
+ * @param ap	Argumentos
+ * @return		El número de caracteres escritos o -1 en caso de error.
+ * 				La condición de error se indica en la variable global errno
+ */
+int bsp_uart_vprintf (uart_id_t uart, const char *fmt, va_list ap) BSP_PRINTF_CHECK (2, 0);
+
+/*****************************************************************************/
+
+/**
+ * Escribe texto con formato en un búfer
+ * Con los formatos de bsp_printf. Escribe como mucho size - 1 caracteres y
+ * termina siempre la cadena (si size no es cero)
+ * @param buf	Búfer
+ * @param size	Tamaño del búfer
+ * @param fmt	Cadena de formato
+ * @return		El número de caracteres que tendría el texto completo, sin el
+ * 				terminador
+ */
+int bsp_snprintf (char *buf, size_t size, const char *fmt, ...) BSP_PRINTF_CHECK (3, 4);
+
+/*****************************************************************************/
+
+/**
+ * Escribe texto con formato en un búfer, con los argumentos en una va_list
+ * @param buf	Búfer
+ * @param size	Tamaño del búfer
+ * @param fmt	Cadena de formato
+ * @param ap	Argumentos
+ * @return		El número de caracteres que tendría el texto completo, sin el
+ * 				terminador
+ */
+int bsp_vsnprintf (char *buf, size_t size, const char *fmt, va_list ap) BSP_PRINTF_CHECK (3, 0);
+
+/*****************************************************************************/
+
+#endif /* __FORMAT_H__ */
@@ -132,6 +132,14 @@ void itc_service_normal_interrupt ();
 
 /*****************************************************************************/
 
+/**
+ * Da servicio a la interrupción normal pendiente de más prioridad permitiendo
+ * que la expulsen las fuentes de más prioridad
+ */
+void itc_service_nested_interrupt ();
+
+/*****************************************************************************/
+
 /**
  * Da servicio a la interrupción rápida pendiente de más prioridad
  */
@@ -0,0 +1,81 @@
+/*
+ * Sistemas operativos empotrados
+ * Soporte de la biblioteca de C (newlib): contextos de reentrada y cerrojos
+ */
+
+#ifndef __LIBC_H__
+#define __LIBC_H__
+
+#include <stdint.h>
+
+struct _reent;
+
+/*****************************************************************************/
+
+/**
+ * Inicializa los contextos de newlib de las isr
+ * Se llama desde bsp_init, antes de habilitar las interrupciones
+ */
+void bsp_libc_init (void);
+
+/*****************************************************************************/
+
+/**
+ * Cambia el contexto de newlib (_impure_ptr) de la CPU
+ * El contexto contiene errno, los FILE de la E/S estándar y el estado interno
+ * de funciones como strtok. Permite dar a cada tarea su propio contexto. Debe
+ * llamarse con las interrupciones deshabilitadas o desde el propio contexto
+ * que se abandona
+ * @param reent	Nuevo contexto, inicializado con _REENT_INIT_PTR
+ * @return		El contexto anterior
+ */
+struct _reent * bsp_reent_switch (struct _reent *reent);
+
+/*****************************************************************************/
+
+/**
+ * Entrada en una isr
+ * Pasa al contexto de newlib del nivel de anidamiento de la isr, de modo que
+ * las isr no comparten errno ni los FILE de la E/S estándar con el código al
+ * que interrumpen. Más allá de BSP_ISR_REENT_LEVELS niveles no hay contexto
+ * libre: la isr sigue en el de la isr interrumpida, que no debe tocar, así que
+ * las llamadas de E/S de syscalls.c fallan con EAGAIN (bsp_isr_reent_overflow)
+ * y la isr no debe usar la biblioteca de C. La llama el ITC antes de servir
+ * cada IRQ, con las IRQ deshabilitadas. Los manejadores FIQ no deben usar la
+ * biblioteca de C
+ */
+void bsp_isr_reent_enter (void);
+
+/*****************************************************************************/
+
+/**
+ * Salida de una isr
+ * Restaura el contexto de newlib anterior a bsp_isr_reent_enter. Se llama con
+ * las IRQ deshabilitadas
+ */
+void bsp_isr_reent_exit (void);
+
+/*****************************************************************************/
+
+/**
+ * Indica si el código se ejecuta dentro de una isr
+ * Las llamadas al sistema lo usan para no bloquearse en una isr, ya que
+ * esperarían a interrupciones que no pueden atenderse hasta que termine, y el
+ * driver de la uart para rechazar a las isr como productoras de su búfer de
+ * transmisión
+ * @return	Distinto de cero dentro de una isr servida por el ITC
+ */
+uint32_t bsp_in_isr (void);
+
+/*****************************************************************************/
+
+/**
+ * Indica si la isr en curso no tiene su propio contexto de newlib
+ * Ocurre cuando el anidamiento supera BSP_ISR_REENT_LEVELS niveles
+ * @return	Distinto de cero si la isr no tiene contexto propio
+ */
+uint32_t bsp_isr_reent_overflow (void);
+
+/*****************************************************************************/
+
+#endif /* __LIBC_H__ */
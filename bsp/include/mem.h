@@ -0,0 +1,70 @@
+/*
+ * Sistemas operativos empotrados
+ * Uso de la memoria: pilas, heap y bloques de tamaño fijo
+ */
+
+#ifndef __MEM_H__
+#define __MEM_H__
+
+#include <stdint.h>
+#include "pool.h"
+
+/*****************************************************************************/
+
+/**
+ * Pilas de los modos de la CPU, definidas en el script de enlazado
+ */
+typedef enum
+{
+	bsp_stack_sys,				/* System y User. También las isr anidadas */
+	bsp_stack_irq,
+	bsp_stack_fiq,
+	bsp_stack_svc,
+	bsp_stack_abt,
+	bsp_stack_und,
+	bsp_stack_max
+} bsp_stack_t;
+
+/*****************************************************************************/
+
+/**
+ * Uso de una pila
+ */
+typedef struct
+{
+	uint32_t size;				/* Tamaño en bytes */
+	uint32_t peak;				/* Máximo de bytes usados desde el arranque */
+} bsp_stack_stats_t;
+
+/*****************************************************************************/
+
+/**
+ * Uso de la memoria
+ */
+typedef struct
+{
+	bsp_stack_stats_t stacks[bsp_stack_max];	/* Indexadas por bsp_stack_t */
+	uint32_t heap_size;			/* Tamaño del heap en bytes */
+	uint32_t heap_used;			/* Bytes entregados por _sbrk */
+	uint32_t heap_peak;			/* Máximo de heap_used desde el arranque */
+	bsp_pool_stats_t pools[BSP_POOL_CLASSES];	/* Asignador de bloques */
+} bsp_mem_stats_t;
+
+/*****************************************************************************/
+
+/**
+ * Obtiene el uso de la memoria
+ * crt0.s rellena las pilas con un patrón antes de usarlas, así que el máximo
+ * de cada pila es la parte en la que el patrón ya no está intacto. Es una cota
+ * inferior: una función que reserve espacio en la pila sin escribirlo no deja
+ * marca. El heap incluye los bloques reservados por bsp_pool_init. La
+ * búsqueda recorre las pilas, así que no debe llamarse desde las isr
+ * @param stats	Estructura donde copiar el uso de la memoria
+ * @return		Cero en caso de éxito o -1 en caso de error.
+ * 				La condición de error se indica en la variable global errno
+ */
+int32_t bsp_mem_stats (bsp_mem_stats_t *stats);
+
+/*****************************************************************************/
+
+#endif /* __MEM_H__ */
@@ -0,0 +1,81 @@
+/*
+ * Sistemas operativos empotrados
+ * Asignador de bloques de tamaño fijo
+ */
+
+#ifndef __POOL_H__
+#define __POOL_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*****************************************************************************/
+
+/**
+ * Número de clases de tamaño del asignador (BSP_POOL_<n>_SIZE y
+ * BSP_POOL_<n>_COUNT en "system.h")
+ */
+#define BSP_POOL_CLASSES	3
+
+/*****************************************************************************/
+
+/**
+ * Ocupación de una clase de tamaño
+ */
+typedef struct
+{
+	uint32_t size;				/* Tamaño de los bloques en bytes */
+	uint32_t count;				/* Número de bloques */
+	uint32_t free;				/* Bloques libres */
+	uint32_t min_free;			/* Mínimo de bloques libres desde el arranque */
+} bsp_pool_stats_t;
+
+/*****************************************************************************/
+
+/**
+ * Inicializa el asignador de bloques
+ * Reserva del heap, con _sbrk, la memoria de todas las clases. Se llama desde
+ * bsp_init, antes de main
+ * @return		Cero en caso de éxito o -1 en caso de error.
+ * 				La condición de error se indica en la variable global errno
+ */
+int32_t bsp_pool_init (void);
+
+/*****************************************************************************/
+
+/**
+ * Reserva un bloque
+ * Se toma de la clase más pequeña con bloques de al menos size bytes y, si está
+ * agotada, de las siguientes. El coste no depende del número de bloques
+ * libres ni de los reservados. A diferencia de malloc, puede llamarse desde
+ * las isr y los bloques no fragmentan el heap
+ * @param size	Tamaño pedido en bytes
+ * @return		Un puntero al bloque, alineado a 4 bytes, o NULL si no hay
+ * 				ninguno libre de ese tamaño.
+ * 				La condición de error se indica en la variable global errno
+ */
+void * bsp_pool_alloc (size_t size);
+
+/*****************************************************************************/
+
+/**
+ * Libera un bloque reservado con bsp_pool_alloc
+ * Puede llamarse desde las isr. El coste es constante
+ * @param ptr	Puntero al bloque. Si es NULL no se hace nada
+ * @return		Cero en caso de éxito o -1 si ptr no apunta al principio de
+ * 				un bloque.
+ * 				La condición de error se indica en la variable global errno
+ */
+int32_t bsp_pool_free (void *ptr);
+
+/*****************************************************************************/
+
+/**
+ * Obtiene la ocupación de las clases de tamaño
+ * @param stats	Estadísticas de cada clase, de menor a mayor tamaño
+ */
+void bsp_pool_get_stats (bsp_pool_stats_t stats[BSP_POOL_CLASSES]);
+
+/*****************************************************************************/
+
+#endif /* __POOL_H__ */
@@ -8,10 +8,18 @@
 
 #include "excep.h"
 #include "dev.h"
+#include "work_queue.h"
 
 #include "itc.h"
+#include "crm.h"
 #include "gpio.h"
 #include "uart.h"
+#include "tmr.h"
+#include "timer_wheel.h"
+#include "pool.h"
+#include "mem.h"
+#include "libc.h"
+#include "format.h"
 
 /*
  * Configuración de la CPU
@@ -20,11 +28,55 @@
 /* Frecuencia de la CPU por defecto (24 MHz) */
 #define CPU_FREQ               24000000u
 
+/* Uso de interrupciones anidadas: 1 para excep_nested_irq_handler, 0 para
+   excep_nonnested_irq_handler */
+#define EXCEP_NESTED_IRQ 1
+
+/* Niveles de anidamiento de las isr con su propio contexto de newlib (errno,
+   E/S estándar). Por defecto, uno por cada fuente del ITC que usa el BSP y que
+   puede anidarse (uart1, uart2, tmr y crm). En una isr más profunda la E/S
+   falla con EAGAIN (ver bsp_isr_reent_enter) */
+#ifndef BSP_ISR_REENT_LEVELS
+#define BSP_ISR_REENT_LEVELS 4
+#endif
+
+/* Número de entradas de la cola de trabajo diferido (potencia de dos) */
+#define BSP_WORK_QUEUE_SIZE 16
+
+/*
+ * Clases de tamaño del asignador de bloques (bsp_pool_alloc)
+ * Tamaño del bloque en bytes (múltiplo de 4, de menor a mayor) y número de
+ * bloques de cada clase. Su memoria se reserva del heap al iniciar el BSP. Un
+ * número de bloques nulo anula la clase
+ */
+#ifndef BSP_POOL_0_SIZE
+#define BSP_POOL_0_SIZE		(32)		/* Temporizadores y nodos pequeños */
+#endif
+#ifndef BSP_POOL_0_COUNT
+#define BSP_POOL_0_COUNT	(32)
+#endif
+#ifndef BSP_POOL_1_SIZE
+#define BSP_POOL_1_SIZE		(128)		/* Paquetes cortos */
+#endif
+#ifndef BSP_POOL_1_COUNT
+#define BSP_POOL_1_COUNT	(16)
+#endif
+#ifndef BSP_POOL_2_SIZE
+#define BSP_POOL_2_SIZE		(256)		/* Paquetes largos */
+#endif
+#ifndef BSP_POOL_2_COUNT
+#define BSP_POOL_2_COUNT	(16)
+#endif
+
 /* Máximo número de dispositivos gestionables por el BSP */
+#ifndef BSP_MAX_DEV
 #define BSP_MAX_DEV 8
+#endif
 
-/* Máximo número de ficheros (dispositivos) abiertos simultánemente */
-#define BSP_MAX_FD 8
+/* Máximo número de ficheros (dispositivos) abiertos simultánemente (hasta 1024) */
+#ifndef BSP_MAX_FD
+#define BSP_MAX_FD 32
+#endif
 
 /*
  * Configuración del GPIO
@@ -40,11 +92,61 @@
 #define UART1_ID		(uart_1)
 #define UART1_BAUDRATE	(115200)
 #define UART1_NAME 		"/dev/uart1"
+#ifndef UART1_RX_MODE
+#define UART1_RX_MODE	(uart_rx_irq)		/* Entrada estándar: usa callbacks */
+#endif
 
 #define UART2_BASE 		((void *) 0x8000b000)
 #define UART2_ID		(uart_2)
 #define UART2_BAUDRATE	(115200)
 #define UART2_NAME 		"/dev/uart2"
+#ifndef UART2_RX_MODE
+#define UART2_RX_MODE	(uart_rx_irq)		/* uart_rx_fiq para recibir por FIQ */
+#endif
+
+/*
+ * Tamaño de los búferes circulares de las UART
+ * Deben ser potencias de dos. Pueden fijarse al compilar con -D<NOMBRE>=<tamaño>
+ * La UART1 se usa como salida estándar, por lo que le damos un búfer de
+ * transmisión grande; la UART2 se usa como enlace de datos entrante, por lo que
+ * le damos un búfer de recepción grande
+ */
+#ifndef UART1_RX_BUFFER_SIZE
+#define UART1_RX_BUFFER_SIZE	(256)
+#endif
+#ifndef UART1_TX_BUFFER_SIZE
+#define UART1_TX_BUFFER_SIZE	(1024)
+#endif
+#ifndef UART2_RX_BUFFER_SIZE
+#define UART2_RX_BUFFER_SIZE	(1024)
+#endif
+#ifndef UART2_TX_BUFFER_SIZE
+#define UART2_TX_BUFFER_SIZE	(256)
+#endif
+
+/* Uart en la que escribe bsp_printf */
+#define BSP_PRINTF_UART	(UART1_ID)
+
+/*
+ * Control de flujo de las UART (uart_set_flow_control)
+ * Bytes en la FIFO de recepción a partir de los que la uart desactiva CTS. Los
+ * huecos restantes de la FIFO (de 32 bytes) absorben lo que el otro extremo
+ * transmita hasta detenerse
+ */
+#define UART_CTS_LEVEL	(24)
+
+/*
+ * Configuración del CRM
+ */
+#define CRM_BASE		((void *) 0x80003000)
+
+/*
+ * Configuración del temporizador del sistema
+ */
+#define TMR_BASE		((void *) 0x80007000)
+#define TMR_NAME		"/dev/tmr"
+#define BSP_TICK_HZ		(1000)					/* Tick de 1 ms */
+#define TMR_MAX_TICK_HOOKS	4					/* Funciones llamadas en cada tick */
 
 /*
  * Configuración de E/S estándar
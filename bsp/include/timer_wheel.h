@@ -0,0 +1,91 @@
+/*
+ * Sistemas operativos empotrados
+ * Temporizadores software sobre el tick del sistema
+ */
+
+#ifndef __TIMER_WHEEL_H__
+#define __TIMER_WHEEL_H__
+
+#include <stdint.h>
+
+/*****************************************************************************/
+
+/**
+ * Prototipo para las funciones que se llaman al vencer un temporizador
+ */
+typedef void (* bsp_timer_func_t) (void *arg);
+
+/*****************************************************************************/
+
+/**
+ * Enlace de una lista doblemente enlazada circular de temporizadores
+ */
+typedef struct bsp_timer_link
+{
+	struct bsp_timer_link *next;
+	struct bsp_timer_link *prev;
+} bsp_timer_link_t;
+
+/*****************************************************************************/
+
+/**
+ * Temporizador software
+ * La memoria la aporta el usuario, así que no hay límite en el número de
+ * temporizadores. Debe estar a cero antes del primer uso (por ejemplo, siendo
+ * una variable global o inicializándolo con memset). Sus campos son privados
+ */
+typedef struct
+{
+	bsp_timer_link_t link;		/* Debe ser el primer campo */
+	uint32_t expires;			/* Tick en el que vence */
+	bsp_timer_func_t func;
+	void *arg;
+} bsp_timer_t;
+
+/*****************************************************************************/
+
+/**
+ * Inicializa los temporizadores software
+ * Se deben inicializar después del temporizador del sistema
+ * @return		Cero en caso de éxito o -1 en caso de error.
+ * 				La condición de error se indica en la variable global errno
+ */
+int32_t bsp_timer_init (void);
+
+/*****************************************************************************/
+
+/**
+ * Arranca un temporizador, o lo rearranca si ya estaba activo
+ * La función se llama como trabajo diferido (ver bsp_run_pending), fuera del
+ * contexto de interrupción. El coste es constante. Sólo debe llamarse en modo
+ * usuario, incluidas las propias funciones de los temporizadores
+ * @param timer	Temporizador
+ * @param ticks	Ticks hasta que venza. La precisión es de un tick
+ * @param func	Función a llamar al vencer
+ * @param arg	Argumento para la función
+ * @return		Cero en caso de éxito o -1 en caso de error.
+ * 				La condición de error se indica en la variable global errno
+ */
+int32_t bsp_timer_start (bsp_timer_t *timer, uint32_t ticks, bsp_timer_func_t func, void *arg);
+
+/*****************************************************************************/
+
+/**
+ * Detiene un temporizador
+ * El coste es constante. Sólo debe llamarse en modo usuario
+ * @param timer	Temporizador
+ * @return		1 si el temporizador estaba activo o 0 si no lo estaba
+ */
+uint32_t bsp_timer_cancel (bsp_timer_t *timer);
+
+/*****************************************************************************/
+
+/**
+ * Retorna 1 si el temporizador está activo
+ * @param timer	Temporizador
+ */
+inline uint32_t bsp_timer_is_active (bsp_timer_t *timer);
+
+/*****************************************************************************/
+
+#endif /* __TIMER_WHEEL_H__ */
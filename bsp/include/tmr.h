@@ -0,0 +1,84 @@
+/*
+ * Sistemas operativos empotrados
+ * Driver para los temporizadores del MC1322x
+ */
+
+#ifndef __TMR_H__
+#define __TMR_H__
+
+#include <stdint.h>
+
+/*****************************************************************************/
+
+/**
+ * Prototipo para las funciones que se llaman en cada tick
+ */
+typedef void (* tmr_tick_hook_t) (void);
+
+/*****************************************************************************/
+
+/**
+ * Inicializa el temporizador del sistema
+ * Configura el canal 0 del bloque TMR como un contador libre de 16 bits que
+ * cuenta ciclos del reloj del bus divididos por 8, y programa su comparador para
+ * generar una interrupción periódica (tick). A partir de ambos se mantiene un
+ * reloj monotónico con resolución de microsegundos
+ * @param hz	Frecuencia del tick en Hz. El periodo debe ser un número entero
+ * 				de microsegundos y caber en el contador de 16 bits
+ * @param name	Nombre del dispositivo
+ * @return		Cero en caso de éxito o -1 en caso de error.
+ * 				La condición de error se indica en la variable global errno
+ */
+int32_t tmr_init (uint32_t hz, const char *name);
+
+/*****************************************************************************/
+
+/**
+ * Añade una función que se llamará en cada tick
+ * La función se ejecuta en la isr del temporizador, así que debe ser breve y
+ * diferir con bsp_work_post el trabajo que no lo sea
+ * @param hook	Función a llamar
+ * @return		Cero en caso de éxito o -1 en caso de error.
+ * 				La condición de error se indica en la variable global errno
+ */
+int32_t tmr_add_tick_hook (tmr_tick_hook_t hook);
+
+/*****************************************************************************/
+
+/**
+ * Retorna el número de ticks transcurridos desde la inicialización del temporizador
+ */
+uint32_t bsp_ticks (void);
+
+/*****************************************************************************/
+
+/**
+ * Retorna el número de microsegundos transcurridos desde la inicialización del
+ * temporizador. El valor es monotónico y no se desborda en la práctica
+ */
+uint64_t bsp_time_us (void);
+
+/*****************************************************************************/
+
+/**
+ * Retorna el número de ciclos de la CPU transcurridos desde la inicialización
+ * del temporizador. Se obtiene del mismo contador que el reloj del sistema, que
+ * cuenta ciclos del reloj del bus divididos por 8, así que la resolución es de
+ * 8 ciclos. Sirve para medir el coste de fragmentos de código
+ */
+uint64_t bsp_cycles (void);
+
+/*****************************************************************************/
+
+/**
+ * Duerme durante el tiempo indicado
+ * La CPU se detiene hasta cada interrupción en vez de esperar activamente.
+ * Mientras tanto se ejecutan los trabajos diferidos por las ISR. La precisión
+ * es de un tick
+ * @param us	Tiempo en microsegundos
+ */
+void bsp_sleep_us (uint32_t us);
+
+/*****************************************************************************/
+
+#endif /* __TMR_H__ */
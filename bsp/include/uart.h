@@ -7,7 +7,11 @@
 #define __UART_H__
 
 #include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
 #include <fcntl.h>
+#include "circular_buffer.h"
+#include "dev.h"
 
 /*****************************************************************************/
 
@@ -23,6 +27,92 @@ typedef enum
 
 /*****************************************************************************/
 
+/**
+ * Modos de atención de las interrupciones de una uart
+ * En modo FIQ el ITC encamina todas las interrupciones de la uart a la FIQ, donde
+ * un manejador en ensamblador mueve los datos entre las FIFO y los búferes
+ * circulares usando los registros replicados del modo FIQ. La latencia de
+ * recepción no depende entonces de lo que tarden los manejadores IRQ, pero
+ * no se invocan las funciones callback de la uart
+ */
+typedef enum
+{
+	uart_rx_irq,
+	uart_rx_fiq,
+	uart_rx_max
+} uart_rx_mode_t;
+
+/*****************************************************************************/
+
+/**
+ * Estadísticas de una uart
+ * Los bits de error del registro de estado se acumulan hasta que se lee, así
+ * que cada contador de errores cuenta las lecturas del estado (una por
+ * interrupción) en las que apareció el error, no los bytes afectados. Los
+ * contadores dan la vuelta al desbordarse
+ */
+typedef struct
+{
+	uint32_t rx_bytes;			/* Bytes recibidos y pasados al búfer de recepción */
+	uint32_t tx_bytes;			/* Bytes pasados del búfer de transmisión a la FIFO */
+	uint32_t parity_errors;		/* Errores de paridad (PE) */
+	uint32_t framing_errors;	/* Errores de trama (FE) */
+	uint32_t rx_overruns;		/* Desbordamientos de la FIFO de recepción (ROE) */
+	uint32_t rx_underruns;		/* Lecturas con la FIFO de recepción vacía (RUE) */
+	uint32_t tx_overruns;		/* Escrituras con la FIFO de transmisión llena (TOE) */
+	uint32_t rx_ring_full;		/* Veces que se llenó el búfer de recepción y se
+								   detuvo la recepción */
+} uart_stats_t;
+
+/*****************************************************************************/
+
+/**
+ * Nivel máximo de las FIFO de las uart
+ */
+#define UART_MAX_LEVEL	31
+
+/*****************************************************************************/
+
+/**
+ * Selección de los búferes que vacía uart_flush
+ */
+#define UART_FLUSH_RX	(1 << 0)
+#define UART_FLUSH_TX	(1 << 1)
+
+/*****************************************************************************/
+
+/**
+ * Órdenes _ioctl de los dispositivos de las uart y su argumento
+ */
+#define UART_IOC_SET_BAUDRATE		0x5501	/* uart_ioc_baudrate_t * */
+#define UART_IOC_GET_BAUDRATE		0x5502	/* uint32_t *: baudrate pedido */
+#define UART_IOC_SET_WATERMARKS		0x5503	/* uart_ioc_watermarks_t * */
+#define UART_IOC_SET_FLOW_CONTROL	0x5504	/* uint32_t *: 1 activar, 0 desactivar */
+#define UART_IOC_FLUSH				0x5505	/* uint32_t *: UART_FLUSH_RX y/o UART_FLUSH_TX */
+#define UART_IOC_GET_STATS			0x5506	/* uart_stats_t * */
+
+/**
+ * Argumento de UART_IOC_SET_BAUDRATE
+ */
+typedef struct
+{
+	uint32_t br;				/* Baudrate pedido */
+	int32_t error_ppm;			/* Retorna el error del baudrate conseguido,
+								   en partes por millón */
+} uart_ioc_baudrate_t;
+
+/**
+ * Argumento de UART_IOC_SET_WATERMARKS (ver uart_set_watermarks)
+ */
+typedef struct
+{
+	uint32_t rx_level;
+	uint32_t tx_level;
+	uint32_t rx_idle_bits;
+} uart_ioc_watermarks_t;
+
+/*****************************************************************************/
+
 /**
  * Definición para las funciones de callback
  */
@@ -35,16 +125,21 @@ typedef void (* uart_callback_t) (void);
  * @param uart	Identificador de la uart
  * @param br	Baudrate
  * @param name	Nombre del dispositivo
+ * @param rx_mode	Modo de atención de las interrupciones (IRQ o FIQ)
  * @return		Cero en caso de éxito o -1 en caso de error.
  * 				La condición de error se indica en la variable global errno
  */
-int32_t uart_init (uart_id_t uart, uint32_t br, const char *name);
+int32_t uart_init (uart_id_t uart, uint32_t br, const char *name, uart_rx_mode_t rx_mode);
 
 /*****************************************************************************/
 
 /**
  * Transmite un byte por la uart
- * Implementación del driver de nivel 0. La llamada se bloquea hasta que transmite el byte
+ * Implementación del driver de nivel 0. El byte se encola en el búfer de
+ * transmisión detrás de los pendientes. Si el búfer está lleno, la CPU se
+ * detiene hasta que la isr le hace hueco. Dentro de una isr o con las IRQ
+ * deshabilitadas el byte se escribe directamente en la FIFO, esperando
+ * activamente a que tenga hueco, así que puede adelantar a los pendientes
  * @param uart	Identificador de la uart
  * @param c		El carácter
  */
@@ -54,7 +149,10 @@ void uart_send_byte (uart_id_t uart, uint8_t c);
 
 /**
  * Recibe un byte por la uart
- * Implementación del driver de nivel 0. La llamada se bloquea hasta que recibe el byte
+ * Implementación del driver de nivel 0. La llamada se bloquea hasta que recibe
+ * el byte, con la CPU detenida entre interrupciones. Dentro de una isr o con
+ * las IRQ deshabilitadas, cuando el búfer de recepción está vacío se espera
+ * activamente a que llegue el byte a la FIFO
  * @param uart	Identificador de la uart
  * @return		El byte recibido
  */
@@ -65,6 +163,8 @@ uint8_t uart_receive_byte (uart_id_t uart);
 /**
  * Transmisión de bytes
  * Implementación del driver de nivel 1. La llamada es no bloqueante y se realiza mediante interrupciones
+ * El búfer de transmisión sólo admite al código de usuario como productor, así
+ * que dentro de una isr falla con EAGAIN
  * @param uart	Identificador de la uart
  * @param buf	Búfer con los caracteres
  * @param count	Número de caracteres a escribir
@@ -90,11 +190,200 @@ ssize_t uart_receive (uint32_t uart, char *buf, size_t count);
 
 /*****************************************************************************/
 
+/**
+ * Transmisión vectorizada de bytes
+ * Implementación del driver de nivel 1. Encola los tramos en orden
+ * directamente en el búfer de transmisión, sin copiarlos antes a un búfer
+ * intermedio. La llamada es no bloqueante: se detiene en el primer tramo que
+ * no cabe entero. Dentro de una isr falla con EAGAIN
+ * @param uart	Identificador de la uart
+ * @param iov	Tramos con los caracteres
+ * @param iovcnt	Número de tramos
+ * @return	El número total de bytes almacenados en el búfer de transmisión
+ *              en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+ssize_t uart_sendv (uint32_t uart, const bsp_iovec_t *iov, int iovcnt);
+
+/*****************************************************************************/
+
+/**
+ * Recepción vectorizada de bytes
+ * Implementación del driver de nivel 1. Reparte los bytes recibidos entre los
+ * tramos, en orden. La llamada es no bloqueante
+ * @param uart	Identificador de la uart
+ * @param iov	Tramos donde almacenar los bytes
+ * @param iovcnt	Número de tramos
+ * @return	El número total de bytes leídos en caso de éxito o -1 en caso de
+ *              error.
+ * 		La condición de error se indica en la variable global errno
+ */
+ssize_t uart_receivev (uint32_t uart, const bsp_iovec_t *iov, int iovcnt);
+
+/*****************************************************************************/
+
+/**
+ * Recepción de bytes con tiempo límite
+ * Si no hay bytes recibidos, la CPU se detiene entre interrupciones hasta que
+ * llega alguno o vence el plazo. No debe llamarse con las IRQ deshabilitadas
+ * @param uart	Identificador de la uart
+ * @param buf	Búfer para almacenar los bytes
+ * @param count	Número de bytes a leer
+ * @param timeout_us	Tiempo máximo de espera en microsegundos
+ * @return	El número de bytes realmente leídos, cero si venció el plazo, o
+ *              -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+ssize_t uart_read_timeout (uart_id_t uart, char *buf, size_t count, uint32_t timeout_us);
+
+/*****************************************************************************/
+
+/**
+ * Consulta los bytes recibidos sin copiarlos
+ * Permite procesar los datos directamente sobre el búfer circular de recepción.
+ * Los bytes no se extraen hasta llamar a uart_rx_consume
+ * @param uart	Identificador de la uart
+ * @param spans	Los dos tramos del búfer de recepción con los bytes recibidos
+ * @return	El número total de bytes disponibles en caso de éxito o
+ *              -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+ssize_t uart_rx_peek (uart_id_t uart, circular_buffer_span_t spans[2]);
+
+/*****************************************************************************/
+
+/**
+ * Extrae bytes ya procesados del búfer de recepción
+ * @param uart	Identificador de la uart
+ * @param count	Número de bytes a extraer
+ * @return	El número de bytes realmente extraídos en caso de éxito o
+ *              -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+ssize_t uart_rx_consume (uart_id_t uart, size_t count);
+
+/*****************************************************************************/
+
+/**
+ * Reserva el espacio libre del búfer de transmisión
+ * Permite generar los datos directamente sobre el búfer circular de
+ * transmisión. No se envían hasta llamar a uart_tx_commit. Como las demás
+ * llamadas de transmisión de nivel 1, falla con EAGAIN dentro de una isr
+ * @param uart	Identificador de la uart
+ * @param spans	Los dos tramos libres del búfer de transmisión
+ * @return	El número total de bytes libres en caso de éxito o
+ *              -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+ssize_t uart_tx_reserve (uart_id_t uart, circular_buffer_span_t spans[2]);
+
+/*****************************************************************************/
+
+/**
+ * Envía los bytes escritos en el espacio obtenido con uart_tx_reserve
+ * @param uart	Identificador de la uart
+ * @param count	Número de bytes escritos
+ * @return	El número de bytes realmente encolados para su envío en caso de
+ *              éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+ssize_t uart_tx_commit (uart_id_t uart, size_t count);
+
+/*****************************************************************************/
+
+/**
+ * Cambia el baudrate de una uart
+ * Busca los valores de INC y MOD, y el sobremuestreo (16x u 8x), que dan el
+ * baudrate más próximo al pedido. Con el reloj de 24 MHz, los baudrates
+ * habituales (hasta 921600, 1500000 y 2000000) son exactos. La uart se
+ * deshabilita mientras se cambia, así que los bytes que estén en la FIFO de
+ * transmisión se cortan. Los que queden en el búfer circular se envían después
+ * con el nuevo baudrate. Para no perder datos hay que esperar a que se hayan
+ * transmitido antes
+ * @param uart	Identificador de la uart
+ * @param br	Baudrate, menor que CPU_FREQ / 8
+ * @param error_ppm	Si no es NULL, error del baudrate conseguido respecto al
+ * 				pedido, en partes por millón
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_set_baudrate (uart_id_t uart, uint32_t br, int32_t *error_ppm);
+
+/*****************************************************************************/
+
+/**
+ * Fija los niveles de las FIFO de una uart y el tiempo de silencio tras el que
+ * se recogen los bytes que no alcanzan el nivel de recepción
+ * Con un nivel de recepción alto la CPU recibe una interrupción por cada
+ * rx_level bytes en vez de una por byte. Los bytes que no llegan al nivel se
+ * recogen cuando la línea lleva rx_idle_bits tiempos de bit en silencio. El
+ * silencio se mide en ticks del sistema, así que se redondea hacia arriba a un
+ * número entero de ticks. El nivel de recepción debe dejar margen en la FIFO
+ * para los bytes que lleguen mientras se atiende la interrupción
+ * @param uart	Identificador de la uart
+ * @param rx_level	Bytes en la FIFO de recepción que provocan una interrupción (1-31)
+ * @param tx_level	Huecos en la FIFO de transmisión que provocan una interrupción (1-31)
+ * @param rx_idle_bits	Tiempos de bit sin recibir tras los que se vacía la
+ * 				FIFO de recepción, o cero para no vaciarla hasta alcanzar el nivel
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_set_watermarks (uart_id_t uart, uint32_t rx_level, uint32_t tx_level, uint32_t rx_idle_bits);
+
+/*****************************************************************************/
+
+/**
+ * Activa o desactiva el control de flujo hardware (RTS/CTS) de una uart
+ * Con el control de flujo activo, la uart deja de transmitir mientras el otro
+ * extremo tiene desactivada su señal CTS, y desactiva la suya cuando su FIFO de
+ * recepción alcanza UART_CTS_LEVEL bytes. Cuando el búfer circular de recepción
+ * se llena, la isr deja de vaciar la FIFO, de modo que el otro extremo se
+ * detiene antes de que se pierdan datos. La recepción se reanuda cuando el
+ * búfer baja de la mitad de su capacidad. El nivel de recepción fijado con
+ * uart_set_watermarks debe ser menor que UART_CTS_LEVEL
+ * @param uart	Identificador de la uart
+ * @param enable	1 para activarlo, 0 para desactivarlo
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_set_flow_control (uart_id_t uart, uint32_t enable);
+
+/*****************************************************************************/
+
+/**
+ * Obtiene las estadísticas de una uart
+ * @param uart	Identificador de la uart
+ * @param stats	Estructura donde copiar las estadísticas
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_get_stats (uart_id_t uart, uart_stats_t *stats);
+
+/*****************************************************************************/
+
+/**
+ * Descarta los datos pendientes de una uart
+ * En recepción se descartan los bytes del búfer circular y de la FIFO. En
+ * transmisión sólo los del búfer circular: los que ya están en la FIFO se
+ * envían igualmente
+ * @param uart	Identificador de la uart
+ * @param which	UART_FLUSH_RX, UART_FLUSH_TX o ambos
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_flush (uart_id_t uart, uint32_t which);
+
+/*****************************************************************************/
+
 /**
  * Fija la función callback de recepción de una uart
+ * La isr no la llama directamente: encola su ejecución para que se haga en modo
+ * usuario desde bsp_run_pending. Sólo está disponible en modo IRQ: el manejador
+ * FIQ no encola callbacks
  * @param uart	Identificador de la uart
  * @param func	Función callback. NULL para anular una selección anterior
- * @return	Cero en caso de éxito o -1 en caso de error.
+ * @return	Cero en caso de éxito o -1 en caso de error (ENOTSUP si la uart
+ * 		trabaja en modo FIQ).
  * 		La condición de error se indica en la variable global errno
  */
 int32_t uart_set_receive_callback (uart_id_t uart, uart_callback_t func);
@@ -103,9 +392,13 @@ int32_t uart_set_receive_callback (uart_id_t uart, uart_callback_t func);
 
 /**
  * Fija la función callback de transmisión de una uart
+ * La isr no la llama directamente: encola su ejecución para que se haga en modo
+ * usuario desde bsp_run_pending. Sólo está disponible en modo IRQ: el manejador
+ * FIQ no encola callbacks
  * @param uart	Identificador de la uart
  * @param func	Función callback. NULL para anular una selección anterior
- * @return	Cero en caso de éxito o -1 en caso de error.
+ * @return	Cero en caso de éxito o -1 en caso de error (ENOTSUP si la uart
+ * 		trabaja en modo FIQ).
  * 		La condición de error se indica en la variable global errno
  */
 int32_t uart_set_send_callback (uart_id_t uart, uart_callback_t func);
@@ -0,0 +1,44 @@
+/*
+ * Sistemas operativos empotrados
+ * Cola de trabajo diferido
+ */
+
+#ifndef __WORK_QUEUE_H__
+#define __WORK_QUEUE_H__
+
+#include <stdint.h>
+
+/*****************************************************************************/
+
+/**
+ * Prototipo para las funciones de trabajo diferido
+ */
+typedef void (* bsp_work_func_t) (void *arg);
+
+/*****************************************************************************/
+
+/**
+ * Encola un trabajo para que se ejecute más tarde en modo usuario
+ * Está pensada para llamarse desde las ISR, que así pueden retornar enseguida
+ * en vez de ejecutar código de usuario en modo IRQ. Sólo funciona en modos
+ * privilegiados. Despierta a quien espera en bsp_poll, que ejecuta los trabajos
+ * @param func	Función a ejecutar
+ * @param arg	Argumento para la función
+ * @return		Cero en caso de éxito o -1 si la cola está llena.
+ * 				La condición de error se indica en la variable global errno
+ */
+int32_t bsp_work_post (bsp_work_func_t func, void *arg);
+
+/*****************************************************************************/
+
+/**
+ * Ejecuta los trabajos pendientes en el orden en que se encolaron
+ * Debe llamarse desde el bucle principal de la aplicación o cuando el sistema
+ * está ocioso. Si se llama desde un trabajo que ya se está ejecutando no hace nada
+ * @return		El número de trabajos ejecutados
+ */
+uint32_t bsp_run_pending (void);
+
+/*****************************************************************************/
+
+#endif /* __WORK_QUEUE_H__ */
@@ -3,23 +3,33 @@
  * Búfer circular
  */
 
+#include <string.h>
 #include "circular_buffer.h"
 
 /*****************************************************************************/
 
+/**
+ * Barrera para el compilador. Impide que los accesos a los datos del búfer se
+ * reordenen con la actualización de los índices, que es lo que los publica al
+ * otro extremo (ISR o código de usuario)
+ */
+#define circular_buffer_barrier()	asm volatile ("" : : : "memory")
+
+/*****************************************************************************/
+
 /**
  * Inicializa un búfer circular dado un puntero a una zona de memoria y su tamaño
  * @param cb	Puntero a la estructura de gestión del búfer circular
  * @param addr	Puntero a la zona de memoria que se gestionará como un búfer circular
- * @param size	Tamaño en bytes del búfer
+ * @param size	Tamaño en bytes del búfer. Debe ser una potencia de dos
  */
 void circular_buffer_init (volatile circular_buffer_t *cb, uint8_t *addr, uint32_t size)
 {
 	cb->data = addr;
 	cb->size = size;
+	cb->mask = size - 1;
 	cb->start = 0;
 	cb->end = 0;
-	cb->count = 0;
 }
 
 /*****************************************************************************/
@@ -30,7 +40,7 @@ void circular_buffer_init (volatile circular_buffer_t *cb, uint8_t *addr, uint32
  */
 inline uint32_t circular_buffer_is_full (volatile circular_buffer_t *cb)
 {
-    return cb->count == cb->size;
+    return cb->end - cb->start == cb->size;
 }
 
 /*****************************************************************************/
@@ -41,7 +51,18 @@ inline uint32_t circular_buffer_is_full (volatile circular_buffer_t *cb)
  */
 inline uint32_t circular_buffer_is_empty (volatile circular_buffer_t *cb)
 {
-    return cb->count == 0;
+    return cb->start == cb->end;
+}
+
+/*****************************************************************************/
+
+/**
+ * Retorna el número de bytes almacenados en el búfer
+ * @param cb	Búfer circular
+ */
+inline uint32_t circular_buffer_count (volatile circular_buffer_t *cb)
+{
+    return cb->end - cb->start;
 }
 
 /*****************************************************************************/
@@ -55,17 +76,18 @@ inline uint32_t circular_buffer_is_empty (volatile circular_buffer_t *cb)
  */
 int32_t circular_buffer_write (volatile circular_buffer_t *cb, uint8_t byte)
 {
+	uint32_t end = cb->end;
+
     /* Escribimos en el búfer sólo si hay espacio */
-    if (circular_buffer_is_full (cb))
+    if (end - cb->start == cb->size)
     	return -1;
     else
     {
-        cb->data[cb->end] = byte;
-        cb->count++;
+        cb->data[end & cb->mask] = byte;
 
-        cb->end++;
-    	if (cb->end == cb->size)
-    		cb->end = 0;
+        /* El dato debe estar en memoria antes de publicar el nuevo índice */
+        circular_buffer_barrier ();
+        cb->end = end + 1;
         return byte;
     }
 }
@@ -81,18 +103,200 @@ int32_t circular_buffer_write (volatile circular_buffer_t *cb, uint8_t byte)
 int32_t circular_buffer_read (volatile circular_buffer_t *cb)
 {
 	int32_t byte;
-    if (circular_buffer_is_empty (cb))
+	uint32_t start = cb->start;
+
+    if (start == cb->end)
     	return -1;
     else
     {
-        byte = cb->data[cb->start];
-        cb->count--;
+        byte = cb->data[start & cb->mask];
 
-        cb->start++;
-    	if (cb->start == cb->size)
-    		cb->start = 0;
+        /* El dato debe leerse antes de liberar su posición al productor */
+        circular_buffer_barrier ();
+        cb->start = start + 1;
         return byte;
     }
 }
 
 /*****************************************************************************/
+
+/**
+ * Consulta los bytes almacenados en un búfer circular sin extraerlos
+ * Sólo debe llamarla el consumidor del búfer
+ * @param cb	Búfer circular
+ * @param spans	Los dos tramos con los bytes almacenados, en orden. El segundo
+ * 				tramo tiene longitud cero si los datos no dan la vuelta
+ * @return		El número total de bytes almacenados
+ */
+uint32_t circular_buffer_peek (volatile circular_buffer_t *cb, circular_buffer_span_t spans[2])
+{
+	uint32_t start = cb->start;
+	uint32_t used = cb->end - start;
+	uint32_t offset = start & cb->mask;
+
+	spans[0].data = cb->data + offset;
+	spans[1].data = cb->data;
+
+	/* Primer tramo hasta el final de la zona de memoria y el resto desde el principio */
+	spans[0].len = cb->size - offset;
+	if (spans[0].len >= used)
+	{
+		spans[0].len = used;
+		spans[1].len = 0;
+	}
+	else
+		spans[1].len = used - spans[0].len;
+
+	/* Los datos no pueden leerse antes que el índice que los publica */
+	circular_buffer_barrier ();
+
+	return spans[0].len + spans[1].len;
+}
+
+/*****************************************************************************/
+
+/**
+ * Extrae bytes de un búfer circular previamente consultados con
+ * circular_buffer_peek
+ * Sólo debe llamarla el consumidor del búfer
+ * @param cb	Búfer circular
+ * @param len	Número de bytes a extraer
+ * @return		El número de bytes extraídos, que puede ser menor que len si
+ * 				el búfer no tiene tantos
+ */
+uint32_t circular_buffer_consume (volatile circular_buffer_t *cb, uint32_t len)
+{
+	uint32_t start = cb->start;
+	uint32_t used = cb->end - start;
+
+	if (len > used)
+		len = used;
+
+	/* Los datos deben leerse antes de liberar sus posiciones al productor */
+	circular_buffer_barrier ();
+	cb->start = start + len;
+
+	return len;
+}
+
+/*****************************************************************************/
+
+/**
+ * Reserva el espacio libre de un búfer circular para escribir en él directamente
+ * Sólo debe llamarla el productor del búfer
+ * @param cb	Búfer circular
+ * @param spans	Los dos tramos de espacio libre, en orden. El segundo tramo
+ * 				tiene longitud cero si el espacio libre no da la vuelta
+ * @return		El número total de bytes libres
+ */
+uint32_t circular_buffer_reserve (volatile circular_buffer_t *cb, circular_buffer_span_t spans[2])
+{
+	uint32_t end = cb->end;
+	uint32_t free = cb->size - (end - cb->start);
+	uint32_t offset = end & cb->mask;
+
+	spans[0].data = cb->data + offset;
+	spans[1].data = cb->data;
+
+	/* Primer tramo hasta el final de la zona de memoria y el resto desde el principio */
+	spans[0].len = cb->size - offset;
+	if (spans[0].len >= free)
+	{
+		spans[0].len = free;
+		spans[1].len = 0;
+	}
+	else
+		spans[1].len = free - spans[0].len;
+
+	return spans[0].len + spans[1].len;
+}
+
+/*****************************************************************************/
+
+/**
+ * Publica bytes escritos directamente en el espacio obtenido con
+ * circular_buffer_reserve
+ * Sólo debe llamarla el productor del búfer
+ * @param cb	Búfer circular
+ * @param len	Número de bytes escritos
+ * @return		El número de bytes publicados, que puede ser menor que len
+ * 				si no había tanto espacio libre
+ */
+uint32_t circular_buffer_commit (volatile circular_buffer_t *cb, uint32_t len)
+{
+	uint32_t end = cb->end;
+	uint32_t free = cb->size - (end - cb->start);
+
+	if (len > free)
+		len = free;
+
+	/* Los datos deben estar en memoria antes de publicar el nuevo índice */
+	circular_buffer_barrier ();
+	cb->end = end + len;
+
+	return len;
+}
+
+/*****************************************************************************/
+
+/**
+ * Escribe un bloque de bytes en un búfer circular
+ * La copia se hace con memcpy en, como mucho, dos tramos contiguos
+ * @param cb	Búfer circular
+ * @param src	Puntero a los bytes a escribir
+ * @param len	Número de bytes a escribir
+ * @return		El número de bytes escritos, que puede ser menor que len si
+ * 				no hay espacio suficiente
+ */
+uint32_t circular_buffer_write_block (volatile circular_buffer_t *cb, const uint8_t *src, uint32_t len)
+{
+	circular_buffer_span_t spans[2];
+	uint32_t free, chunk;
+
+	free = circular_buffer_reserve (cb, spans);
+	if (len > free)
+		len = free;
+
+	/* Primer tramo: hasta el final de la zona de memoria */
+	chunk = (spans[0].len < len) ? spans[0].len : len;
+	memcpy (spans[0].data, src, chunk);
+
+	/* Segundo tramo: desde el principio de la zona de memoria */
+	if (len > chunk)
+		memcpy (spans[1].data, src + chunk, len - chunk);
+
+	return circular_buffer_commit (cb, len);
+}
+
+/*****************************************************************************/
+
+/**
+ * Lee un bloque de bytes de un búfer circular
+ * La copia se hace con memcpy en, como mucho, dos tramos contiguos
+ * @param cb	Búfer circular
+ * @param dst	Puntero a la zona donde se almacenarán los bytes
+ * @param len	Número máximo de bytes a leer
+ * @return		El número de bytes leídos, que puede ser menor que len si
+ * 				el búfer no tiene tantos
+ */
+uint32_t circular_buffer_read_block (volatile circular_buffer_t *cb, uint8_t *dst, uint32_t len)
+{
+	circular_buffer_span_t spans[2];
+	uint32_t used, chunk;
+
+	used = circular_buffer_peek (cb, spans);
+	if (len > used)
+		len = used;
+
+	/* Primer tramo: hasta el final de la zona de memoria */
+	chunk = (spans[0].len < len) ? spans[0].len : len;
+	memcpy (dst, spans[0].data, chunk);
+
+	/* Segundo tramo: desde el principio de la zona de memoria */
+	if (len > chunk)
+		memcpy (dst + chunk, spans[1].data, len - chunk);
+
+	return circular_buffer_consume (cb, len);
+}
+
+/*****************************************************************************/
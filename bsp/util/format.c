@@ -0,0 +1,559 @@
+/*
+ * Sistemas operativos empotrados
+ * Formateo de texto ligero (bsp_printf), sin la E/S estándar de newlib
+ *
+ * El formateador escribe en una salida que le ofrece un tramo de memoria
+ * (cur, end). Cuando lo agota, la salida le da otro: el siguiente tramo del
+ * búfer de transmisión de una uart, o ninguno si es un búfer de usuario. Así
+ * escribir un carácter es una comparación y un almacenamiento
+ */
+
+#include <errno.h>
+#include "system.h"
+
+/*****************************************************************************/
+
+/**
+ * Salida del formateador
+ */
+typedef struct bsp_fmt_out
+{
+	char *cur;					/* Siguiente posición del tramo actual */
+	char *end;					/* Fin del tramo actual */
+	uint32_t count;				/* Caracteres generados */
+	/* Da un nuevo tramo. Retorna -1 si no hay más y el resto se descarta */
+	int32_t (*next) (struct bsp_fmt_out *out);
+	/* Salida a una uart */
+	uart_id_t uart;
+	circular_buffer_span_t spans[2];
+	uint32_t span;				/* Tramo actual */
+	uint32_t committed;			/* Caracteres ya enviados con uart_tx_commit */
+} bsp_fmt_out_t;
+
+/*****************************************************************************/
+
+/**
+ * Indicadores de una conversión
+ */
+#define BSP_FMT_LEFT	(1 << 0)	/* - */
+#define BSP_FMT_ZERO	(1 << 1)	/* 0 */
+#define BSP_FMT_PLUS	(1 << 2)	/* + */
+#define BSP_FMT_SPACE	(1 << 3)	/* espacio */
+#define BSP_FMT_UPPER	(1 << 4)	/* X */
+#define BSP_FMT_PREC	(1 << 5)	/* Hay precisión */
+#define BSP_FMT_ALT		(1 << 6)	/* # */
+
+/*****************************************************************************/
+
+/**
+ * Escribe un carácter en la salida
+ * @param out	La salida
+ * @param c		El carácter
+ */
+static inline void bsp_fmt_putc (bsp_fmt_out_t *out, char c)
+{
+	out->count++;
+	if (out->cur == out->end && out->next (out) < 0)
+		return;
+	*out->cur++ = c;
+}
+
+/*****************************************************************************/
+
+/**
+ * Escribe n veces un carácter de relleno
+ * @param out	La salida
+ * @param c		El carácter
+ * @param n		Número de veces, puede ser negativo
+ */
+static void bsp_fmt_pad (bsp_fmt_out_t *out, char c, int32_t n)
+{
+	while (n-- > 0)
+		bsp_fmt_putc (out, c);
+}
+
+/*****************************************************************************/
+
+/**
+ * Escribe un entero
+ * Las conversiones en base 10 de 32 bits usan la división por una constante,
+ * que gcc convierte en una multiplicación. Las de 64 bits necesitan la
+ * división de libgcc
+ * @param out	La salida
+ * @param value	Valor absoluto
+ * @param neg	Indica si es negativo
+ * @param base	Base (8, 10 o 16)
+ * @param flags	Indicadores BSP_FMT_*
+ * @param width	Ancho mínimo
+ * @param prec	Mínimo de dígitos
+ */
+static void bsp_fmt_int (bsp_fmt_out_t *out, uint64_t value, uint32_t neg,
+		uint32_t base, uint32_t flags, int32_t width, int32_t prec)
+{
+	const char *digits = (flags & BSP_FMT_UPPER) ? "0123456789ABCDEF" : "0123456789abcdef";
+	char buf[24];
+	char sign = 0;
+	int32_t len = 0, alt = 0;
+	uint32_t v32;
+
+	/* Con #, el hexadecimal distinto de cero lleva el prefijo 0x */
+	if ((flags & BSP_FMT_ALT) && base == 16 && value != 0)
+		alt = 2;
+
+	if (neg)
+		sign = '-';
+	else if (flags & BSP_FMT_PLUS)
+		sign = '+';
+	else if (flags & BSP_FMT_SPACE)
+		sign = ' ';
+
+	/* Los dígitos se generan de menos a más significativo */
+	if (value >> 32)
+	{
+		do
+		{
+			buf[len++] = digits[value % base];
+			value /= base;
+		} while (value >> 32);
+	}
+	v32 = (uint32_t) value;
+	if (base == 10)
+	{
+		do
+		{
+			buf[len++] = '0' + v32 % 10;
+			v32 /= 10;
+		} while (v32);
+	}
+	else
+	{
+		do
+		{
+			buf[len++] = digits[v32 & (base - 1)];
+			v32 >>= (base == 16) ? 4 : 3;
+		} while (v32);
+	}
+
+	/* Con precisión cero, el valor cero no se escribe */
+	if ((flags & BSP_FMT_PREC) && prec == 0 && len == 1 && buf[0] == '0')
+		len = 0;
+
+	/* El relleno con ceros equivale a una precisión */
+	if (!(flags & BSP_FMT_PREC) && (flags & BSP_FMT_ZERO) && !(flags & BSP_FMT_LEFT))
+		prec = width - (sign != 0) - alt;
+	if (prec < len)
+		prec = len;
+
+	/* Con #, el octal empieza siempre por 0 */
+	if ((flags & BSP_FMT_ALT) && base == 8 && prec == len && (len == 0 || buf[len - 1] != '0'))
+		prec = len + 1;
+	width -= prec + (sign != 0) + alt;
+
+	if (!(flags & BSP_FMT_LEFT))
+		bsp_fmt_pad (out, ' ', width);
+	if (sign)
+		bsp_fmt_putc (out, sign);
+	if (alt)
+	{
+		bsp_fmt_putc (out, '0');
+		bsp_fmt_putc (out, (flags & BSP_FMT_UPPER) ? 'X' : 'x');
+	}
+	bsp_fmt_pad (out, '0', prec - len);
+	while (len > 0)
+		bsp_fmt_putc (out, buf[--len]);
+	if (flags & BSP_FMT_LEFT)
+		bsp_fmt_pad (out, ' ', width);
+}
+
+/*****************************************************************************/
+
+/**
+ * Formateador
+ * @param out	La salida
+ * @param fmt	Cadena de formato
+ * @param ap	Argumentos
+ */
+static void bsp_format (bsp_fmt_out_t *out, const char *fmt, va_list ap)
+{
+	uint32_t flags, base;
+	int32_t lng, width, prec, len, i;
+	const char *s;
+	uint64_t value;
+	int64_t svalue;
+	char c;
+
+	while ((c = *fmt++) != '\0')
+	{
+		if (c != '%')
+		{
+			bsp_fmt_putc (out, c);
+			continue;
+		}
+
+		/* Indicadores */
+		flags = 0;
+		while (1)
+		{
+			c = *fmt++;
+			if (c == '-')
+				flags |= BSP_FMT_LEFT;
+			else if (c == '0')
+				flags |= BSP_FMT_ZERO;
+			else if (c == '+')
+				flags |= BSP_FMT_PLUS;
+			else if (c == ' ')
+				flags |= BSP_FMT_SPACE;
+			else if (c == '#')
+				flags |= BSP_FMT_ALT;
+			else
+				break;
+		}
+
+		/* Ancho */
+		width = 0;
+		if (c == '*')
+		{
+			width = va_arg (ap, int);
+			if (width < 0)
+			{
+				flags |= BSP_FMT_LEFT;
+				width = -width;
+			}
+			c = *fmt++;
+		}
+		else
+			for (; c >= '0' && c <= '9'; c = *fmt++)
+				width = width * 10 + c - '0';
+
+		/* Precisión */
+		prec = 0;
+		if (c == '.')
+		{
+			flags |= BSP_FMT_PREC;
+			c = *fmt++;
+			if (c == '*')
+			{
+				prec = va_arg (ap, int);
+				if (prec < 0)
+					flags &= ~BSP_FMT_PREC;
+				c = *fmt++;
+			}
+			else
+				for (; c >= '0' && c <= '9'; c = *fmt++)
+					prec = prec * 10 + c - '0';
+		}
+
+		/* Longitud: 0 para int, 1 para long, size_t y ptrdiff_t, 2 para long
+		long e intmax_t, -1 para short, -2 para char y 3 para long double (L,
+		que con los enteros se trata como ll) */
+		lng = 0;
+		while (c == 'h' || c == 'l' || c == 'z' || c == 't' || c == 'j' || c == 'L')
+		{
+			if (c == 'l')
+				lng++;
+			else if (c == 'h')
+				lng--;
+			else if (c == 'j')
+				lng = 2;
+			else if (c == 'L')
+				lng = 3;
+			else
+				lng = 1;
+			c = *fmt++;
+		}
+
+		base = 10;
+		switch (c)
+		{
+		case 'd':
+		case 'i':
+			if (lng > 1)
+				svalue = va_arg (ap, long long);
+			else if (lng)
+				svalue = va_arg (ap, long);
+			else
+				svalue = va_arg (ap, int);
+			/* Los argumentos char y short llegan promocionados a int */
+			if (lng == -1)
+				svalue = (short) svalue;
+			else if (lng < -1)
+				svalue = (signed char) svalue;
+			bsp_fmt_int (out, svalue < 0 ? -(uint64_t) svalue : (uint64_t) svalue,
+					svalue < 0, 10, flags, width, prec);
+			break;
+
+		case 'X':
+			flags |= BSP_FMT_UPPER;
+			/* no break */
+		case 'x':
+			base = 16;
+			/* no break */
+		case 'o':
+			if (c == 'o')
+				base = 8;
+			/* no break */
+		case 'u':
+			if (lng > 1)
+				value = va_arg (ap, unsigned long long);
+			else if (lng)
+				value = va_arg (ap, unsigned long);
+			else
+				value = va_arg (ap, unsigned int);
+			if (lng == -1)
+				value = (unsigned short) value;
+			else if (lng < -1)
+				value = (unsigned char) value;
+			bsp_fmt_int (out, value, 0, base, flags & ~(BSP_FMT_PLUS | BSP_FMT_SPACE),
+					width, prec);
+			break;
+
+		case 'p':
+			bsp_fmt_putc (out, '0');
+			bsp_fmt_putc (out, 'x');
+			bsp_fmt_int (out, (uintptr_t) va_arg (ap, void *), 0, 16,
+					BSP_FMT_PREC, 0, 2 * sizeof (void *));
+			break;
+
+		case 'c':
+			if (!(flags & BSP_FMT_LEFT))
+				bsp_fmt_pad (out, ' ', width - 1);
+			bsp_fmt_putc (out, (char) va_arg (ap, int));
+			if (flags & BSP_FMT_LEFT)
+				bsp_fmt_pad (out, ' ', width - 1);
+			break;
+
+		case 's':
+			s = va_arg (ap, const char *);
+			if (s == NULL)
+				s = "(null)";
+			for (len = 0; s[len] && (!(flags & BSP_FMT_PREC) || len < prec); len++)
+				;
+			if (!(flags & BSP_FMT_LEFT))
+				bsp_fmt_pad (out, ' ', width - len);
+			for (i = 0; i < len; i++)
+				bsp_fmt_putc (out, s[i]);
+			if (flags & BSP_FMT_LEFT)
+				bsp_fmt_pad (out, ' ', width - len);
+			break;
+
+		case '%':
+			bsp_fmt_putc (out, '%');
+			break;
+
+		case 'e':
+		case 'E':
+		case 'f':
+		case 'F':
+		case 'g':
+		case 'G':
+		case 'a':
+		case 'A':
+			/* Coma flotante: no se admite, pero se consume el argumento para
+			no desplazar los siguientes */
+			if (lng == 3)
+				(void) va_arg (ap, long double);
+			else
+				(void) va_arg (ap, double);
+			bsp_fmt_putc (out, '%');
+			bsp_fmt_putc (out, c);
+			break;
+
+		case '\0':
+			/* Conversión incompleta al final de la cadena */
+			return;
+
+		case 'n':
+			/* No se admite, pero se consume el puntero para no desplazar los
+			argumentos siguientes */
+			(void) va_arg (ap, void *);
+			/* no break */
+		default:
+			/* Conversión desconocida: se escribe tal cual */
+			bsp_fmt_putc (out, '%');
+			bsp_fmt_putc (out, c);
+			break;
+		}
+	}
+}
+
+/*****************************************************************************/
+
+/**
+ * Siguiente tramo de la salida a un búfer, o de una salida truncada: no hay más
+ */
+static int32_t bsp_fmt_buf_next (bsp_fmt_out_t *out)
+{
+	return -1;
+}
+
+/*****************************************************************************/
+
+/**
+ * Siguiente tramo de la salida a una uart
+ * Pasa al segundo tramo libre del búfer de transmisión o, si no hay, envía lo
+ * escrito y espera a que la isr libere espacio. Si la isr no puede ejecutarse,
+ * trunca la salida
+ */
+static int32_t bsp_fmt_uart_next (bsp_fmt_out_t *out)
+{
+	ssize_t n = 0;
+
+	if (out->span == 0 && out->spans[1].len)
+		out->span = 1;
+	else
+	{
+		/* count ya incluye el carácter que no cabe */
+		uart_tx_commit (out->uart, out->count - 1 - out->committed);
+		out->committed = out->count - 1;
+
+		/* Dentro de una isr o con las IRQ deshabilitadas no se liberaría
+		espacio, así que el resto se descarta */
+		if (!bsp_in_isr () && excep_irq_enabled ())
+			while ((n = uart_tx_reserve (out->uart, out->spans)) == 0)
+				crm_wait_for_interrupt ();
+		if (n <= 0)
+		{
+			out->next = bsp_fmt_buf_next;
+			return -1;
+		}
+		out->span = 0;
+	}
+
+	out->cur = (char *) out->spans[out->span].data;
+	out->end = out->cur + out->spans[out->span].len;
+
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Escribe texto con formato en una uart, con los argumentos en una va_list
+ * @param uart	Identificador de la uart
+ * @param fmt	Cadena de formato
+ * @param ap	Argumentos
+ * @return		El número de caracteres escritos o -1 en caso de error.
+ * 				La condición de error se indica en la variable global errno
+ */
+int bsp_uart_vprintf (uart_id_t uart, const char *fmt, va_list ap)
+{
+	bsp_fmt_out_t out;
+
+	if (fmt == NULL)
+	{
+		errno = EFAULT;
+		return -1;
+	}
+	if (uart_tx_reserve (uart, out.spans) < 0)
+		return -1;
+
+	out.uart = uart;
+	out.span = 0;
+	out.count = out.committed = 0;
+	out.next = bsp_fmt_uart_next;
+	out.cur = (char *) out.spans[0].data;
+	out.end = out.cur + out.spans[0].len;
+
+	bsp_format (&out, fmt, ap);
+
+	/* Si se truncó la salida, lo escrito ya está enviado */
+	if (out.next == bsp_fmt_uart_next)
+	{
+		uart_tx_commit (uart, out.count - out.committed);
+		out.committed = out.count;
+	}
+
+	return out.committed;
+}
+
+/*****************************************************************************/
+
+/**
+ * Escribe texto con formato en una uart
+ * @param uart	Identificador de la uart
+ * @param fmt	Cadena de formato
+ * @return		El número de caracteres escritos o -1 en caso de error.
+ * 				La condición de error se indica en la variable global errno
+ */
+int bsp_uart_printf (uart_id_t uart, const char *fmt, ...)
+{
+	va_list ap;
+	int ret;
+
+	va_start (ap, fmt);
+	ret = bsp_uart_vprintf (uart, fmt, ap);
+	va_end (ap);
+
+	return ret;
+}
+
+/*****************************************************************************/
+
+/**
+ * Escribe texto con formato en la uart de bsp_printf (BSP_PRINTF_UART)
+ * @param fmt	Cadena de formato
+ * @return		El número de caracteres escritos
+ */
+int bsp_printf (const char *fmt, ...)
+{
+	va_list ap;
+	int ret;
+
+	va_start (ap, fmt);
+	ret = bsp_uart_vprintf (BSP_PRINTF_UART, fmt, ap);
+	va_end (ap);
+
+	return ret;
+}
+
+/*****************************************************************************/
+
+/**
+ * Escribe texto con formato en un búfer, con los argumentos en una va_list
+ * @param buf	Búfer
+ * @param size	Tamaño del búfer
+ * @param fmt	Cadena de formato
+ * @param ap	Argumentos
+ * @return		El número de caracteres que tendría el texto completo, sin el
+ * 				terminador
+ */
+int bsp_vsnprintf (char *buf, size_t size, const char *fmt, va_list ap)
+{
+	bsp_fmt_out_t out;
+
+	out.count = 0;
+	out.next = bsp_fmt_buf_next;
+	out.cur = buf;
+	out.end = size ? buf + size - 1 : buf;
+
+	bsp_format (&out, fmt, ap);
+
+	if (size)
+		*out.cur = '\0';
+
+	return out.count;
+}
+
+/*****************************************************************************/
+
+/**
+ * Escribe texto con formato en un búfer
+ * @param buf	Búfer
+ * @param size	Tamaño del búfer
+ * @param fmt	Cadena de formato
+ * @return		El número de caracteres que tendría el texto completo, sin el
+ * 				terminador
+ */
+int bsp_snprintf (char *buf, size_t size, const char *fmt, ...)
+{
+	va_list ap;
+	int ret;
+
+	va_start (ap, fmt);
+	ret = bsp_vsnprintf (buf, size, fmt, ap);
+	va_end (ap);
+
+	return ret;
+}
+
+/*****************************************************************************/
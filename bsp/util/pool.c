@@ -0,0 +1,217 @@
+/*
+ * Sistemas operativos empotrados
+ * Asignador de bloques de tamaño fijo
+ *
+ * Cada clase de tamaño ocupa una zona contigua del heap, reservada con _sbrk
+ * al iniciar el BSP, dividida en bloques iguales. Los bloques libres forman
+ * una lista enlazada a través de su primera palabra, así que reservar es sacar
+ * la cabeza de la lista y liberar es volver a meter el bloque. La clase de un
+ * bloque se deduce de la zona en la que está
+ *
+ * Las isr también reservan y liberan bloques. El ARM7TDMI no tiene
+ * instrucciones de acceso exclusivo con las que modificar la lista sin
+ * bloqueos, así que cada operación se hace en una sección crítica de unas
+ * pocas instrucciones
+ */
+
+#include <errno.h>
+#include "system.h"
+
+/*****************************************************************************/
+
+/**
+ * Ampliación del heap, en syscalls.c
+ */
+extern void * _sbrk (intptr_t incr);
+
+/*****************************************************************************/
+
+/**
+ * Comprobación de la configuración
+ */
+#define BSP_POOL_CHECK_SIZE(n) \
+	typedef char BSP_POOL_##n##_SIZE_must_be_a_multiple_of_4 \
+		[(BSP_POOL_##n##_SIZE >= 4 && BSP_POOL_##n##_SIZE % 4 == 0) ? 1 : -1]
+
+BSP_POOL_CHECK_SIZE (0);
+BSP_POOL_CHECK_SIZE (1);
+BSP_POOL_CHECK_SIZE (2);
+
+/*****************************************************************************/
+
+/**
+ * Bloque libre
+ */
+typedef struct bsp_pool_block
+{
+	struct bsp_pool_block *next;
+} bsp_pool_block_t;
+
+/**
+ * Clase de tamaño
+ */
+typedef struct
+{
+	bsp_pool_block_t *free;		/* Lista de bloques libres */
+	char *base;					/* Zona de la clase */
+	char *limit;
+	uint32_t free_count;		/* Bloques en la lista */
+	uint32_t min_free;			/* Mínimo de free_count */
+} bsp_pool_t;
+
+/*****************************************************************************/
+
+/**
+ * Tamaño y número de bloques de cada clase
+ */
+static const uint32_t bsp_pool_sizes[BSP_POOL_CLASSES] =
+		{BSP_POOL_0_SIZE, BSP_POOL_1_SIZE, BSP_POOL_2_SIZE};
+static const uint32_t bsp_pool_counts[BSP_POOL_CLASSES] =
+		{BSP_POOL_0_COUNT, BSP_POOL_1_COUNT, BSP_POOL_2_COUNT};
+
+/**
+ * Clases de tamaño
+ */
+static bsp_pool_t bsp_pools[BSP_POOL_CLASSES];
+
+/*****************************************************************************/
+
+/**
+ * Inicializa el asignador de bloques
+ * @return		Cero en caso de éxito o -1 en caso de error.
+ * 				La condición de error se indica en la variable global errno
+ */
+int32_t bsp_pool_init (void)
+{
+	bsp_pool_t *pool;
+	char *block;
+	uint32_t i, j;
+
+	for (i = 0; i < BSP_POOL_CLASSES; i++)
+	{
+		pool = & bsp_pools[i];
+		pool->free = NULL;
+		pool->base = pool->limit = NULL;
+		pool->free_count = pool->min_free = 0;
+
+		if (bsp_pool_counts[i] == 0)
+			continue;
+
+		block = _sbrk (bsp_pool_sizes[i] * bsp_pool_counts[i]);
+		if (block == (void *) -1)
+			return -1;
+
+		pool->base = block;
+		pool->limit = block + bsp_pool_sizes[i] * bsp_pool_counts[i];
+
+		/* Encadenamos los bloques en orden de direcciones */
+		for (j = bsp_pool_counts[i]; j > 0; j--)
+		{
+			block = pool->base + (j - 1) * bsp_pool_sizes[i];
+			((bsp_pool_block_t *) block)->next = pool->free;
+			pool->free = (bsp_pool_block_t *) block;
+		}
+		pool->free_count = pool->min_free = bsp_pool_counts[i];
+	}
+
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Reserva un bloque
+ * @param size	Tamaño pedido en bytes
+ * @return		Un puntero al bloque o NULL si no hay ninguno libre.
+ * 				La condición de error se indica en la variable global errno
+ */
+void * bsp_pool_alloc (size_t size)
+{
+	bsp_pool_block_t *block;
+	uint32_t i, state;
+
+	for (i = 0; i < BSP_POOL_CLASSES; i++)
+	{
+		if (size > bsp_pool_sizes[i])
+			continue;
+
+		state = excep_critical_enter ();
+		block = bsp_pools[i].free;
+		if (block)
+		{
+			bsp_pools[i].free = block->next;
+			if (--bsp_pools[i].free_count < bsp_pools[i].min_free)
+				bsp_pools[i].min_free = bsp_pools[i].free_count;
+		}
+		excep_critical_exit (state);
+
+		if (block)
+			return block;
+	}
+
+	errno = ENOMEM;
+	return NULL;
+}
+
+/*****************************************************************************/
+
+/**
+ * Libera un bloque reservado con bsp_pool_alloc
+ * @param ptr	Puntero al bloque. Si es NULL no se hace nada
+ * @return		Cero en caso de éxito o -1 si ptr no apunta al principio de
+ * 				un bloque.
+ * 				La condición de error se indica en la variable global errno
+ */
+int32_t bsp_pool_free (void *ptr)
+{
+	bsp_pool_block_t *block = ptr;
+	uint32_t i, state;
+
+	if (ptr == NULL)
+		return 0;
+
+	for (i = 0; i < BSP_POOL_CLASSES; i++)
+	{
+		if ((char *) ptr < bsp_pools[i].base || (char *) ptr >= bsp_pools[i].limit)
+			continue;
+
+		/* Un puntero al interior de un bloque corrompería la lista libre */
+		if (((char *) ptr - bsp_pools[i].base) % bsp_pool_sizes[i] != 0)
+			break;
+
+		state = excep_critical_enter ();
+		block->next = bsp_pools[i].free;
+		bsp_pools[i].free = block;
+		bsp_pools[i].free_count++;
+		excep_critical_exit (state);
+
+		return 0;
+	}
+
+	errno = EINVAL;
+	return -1;
+}
+
+/*****************************************************************************/
+
+/**
+ * Obtiene la ocupación de las clases de tamaño
+ * @param stats	Estadísticas de cada clase, de menor a mayor tamaño
+ */
+void bsp_pool_get_stats (bsp_pool_stats_t stats[BSP_POOL_CLASSES])
+{
+	uint32_t i, state;
+
+	for (i = 0; i < BSP_POOL_CLASSES; i++)
+	{
+		stats[i].size = bsp_pool_sizes[i];
+		stats[i].count = bsp_pools[i].base ? bsp_pool_counts[i] : 0;
+
+		state = excep_critical_enter ();
+		stats[i].free = bsp_pools[i].free_count;
+		stats[i].min_free = bsp_pools[i].min_free;
+		excep_critical_exit (state);
+	}
+}
+
+/*****************************************************************************/
@@ -0,0 +1,323 @@
+/*
+ * Sistemas operativos empotrados
+ * Temporizadores software sobre el tick del sistema
+ *
+ * Rueda de temporizadores jerárquica. El nivel 0 tiene una ranura por tick y
+ * cada ranura de los niveles superiores cubre una vuelta completa del nivel
+ * anterior. Un temporizador se inserta en la ranura del nivel que corresponde
+ * a su distancia al tick actual, así que insertarlo y cancelarlo cuesta lo
+ * mismo sea cual sea el número de temporizadores. Cuando el nivel 0 completa
+ * una vuelta, la siguiente ranura del nivel 1 se reparte en el nivel 0 (y lo
+ * mismo con los niveles superiores)
+ *
+ * La isr del tick sólo encola un trabajo diferido. La rueda se procesa y los
+ * temporizadores vencidos se atienden en modo usuario, por lo que todas las
+ * operaciones sobre la rueda se hacen en modo usuario y no necesitan regiones
+ * críticas
+ */
+
+#include <errno.h>
+#include "system.h"
+
+/*****************************************************************************/
+
+/**
+ * Geometría de la rueda: 4 niveles de 64 ranuras, que cubren 2^24 ticks
+ * (más de 4 horas con un tick de 1 ms). Los temporizadores más largos se
+ * acortan a ese máximo
+ */
+#define BSP_TIMER_LEVELS		4
+#define BSP_TIMER_SLOT_BITS		6
+#define BSP_TIMER_SLOTS			(1 << BSP_TIMER_SLOT_BITS)
+#define BSP_TIMER_SLOT_MASK		(BSP_TIMER_SLOTS - 1)
+#define BSP_TIMER_MAX_TICKS		((1 << (BSP_TIMER_LEVELS * BSP_TIMER_SLOT_BITS)) - 1)
+
+/*****************************************************************************/
+
+/**
+ * Ranuras de la rueda. Cada una es la cabecera de una lista circular
+ */
+static bsp_timer_link_t bsp_timer_wheel[BSP_TIMER_LEVELS][BSP_TIMER_SLOTS];
+
+/**
+ * Siguiente tick por procesar
+ */
+static uint32_t bsp_timer_now = 0;
+
+/**
+ * Número de temporizadores activos. Lo consulta la isr del tick
+ */
+static volatile uint32_t bsp_timer_count = 0;
+
+/**
+ * Indica si el trabajo que procesa la rueda ya está encolado
+ */
+static volatile uint32_t bsp_timer_work_pending = 0;
+
+/*****************************************************************************/
+
+/**
+ * Inserta un enlace al final de una lista
+ * @param head	Cabecera de la lista
+ * @param link	Enlace a insertar
+ */
+static inline void bsp_timer_list_add (bsp_timer_link_t *head, bsp_timer_link_t *link)
+{
+	link->next = head;
+	link->prev = head->prev;
+	head->prev->next = link;
+	head->prev = link;
+}
+
+/*****************************************************************************/
+
+/**
+ * Saca un enlace de la lista en la que está
+ * @param link	Enlace a sacar
+ */
+static inline void bsp_timer_list_del (bsp_timer_link_t *link)
+{
+	link->prev->next = link->next;
+	link->next->prev = link->prev;
+	link->next = link->prev = NULL;
+}
+
+/*****************************************************************************/
+
+/**
+ * Mueve todos los enlaces de una lista a otra vacía
+ * @param from	Cabecera de la lista origen, que queda vacía
+ * @param to	Cabecera de la lista destino
+ */
+static inline void bsp_timer_list_move (bsp_timer_link_t *from, bsp_timer_link_t *to)
+{
+	if (from->next == from)
+	{
+		to->next = to->prev = to;
+		return;
+	}
+
+	to->next = from->next;
+	to->prev = from->prev;
+	to->next->prev = to;
+	to->prev->next = to;
+	from->next = from->prev = from;
+}
+
+/*****************************************************************************/
+
+/**
+ * Inserta un temporizador en la ranura que le corresponde según su distancia
+ * al siguiente tick por procesar
+ * @param timer	Temporizador
+ */
+static void bsp_timer_insert (bsp_timer_t *timer)
+{
+	uint32_t delta = timer->expires - bsp_timer_now;
+	uint32_t level;
+
+	if ((int32_t) delta < 0)
+	{
+		/* Ya ha vencido: lo atendemos en el siguiente tick que se procese */
+		timer->expires = bsp_timer_now;
+		delta = 0;
+	}
+	else if (delta > BSP_TIMER_MAX_TICKS)
+	{
+		timer->expires = bsp_timer_now + BSP_TIMER_MAX_TICKS;
+		delta = BSP_TIMER_MAX_TICKS;
+	}
+
+	for (level = 0; level < BSP_TIMER_LEVELS - 1; level++)
+		if (delta < (1 << ((level + 1) * BSP_TIMER_SLOT_BITS)))
+			break;
+
+	bsp_timer_list_add (&bsp_timer_wheel[level]
+			[(timer->expires >> (level * BSP_TIMER_SLOT_BITS)) & BSP_TIMER_SLOT_MASK],
+			&timer->link);
+}
+
+/*****************************************************************************/
+
+/**
+ * Reparte una ranura de un nivel superior en los niveles inferiores
+ * @param level	Nivel
+ * @param slot	Ranura
+ * @return		La ranura
+ */
+static uint32_t bsp_timer_cascade (uint32_t level, uint32_t slot)
+{
+	bsp_timer_link_t list;
+
+	bsp_timer_list_move (&bsp_timer_wheel[level][slot], &list);
+
+	while (list.next != &list)
+	{
+		bsp_timer_link_t *link = list.next;
+
+		bsp_timer_list_del (link);
+		bsp_timer_insert ((bsp_timer_t *) link);
+	}
+
+	return slot;
+}
+
+/*****************************************************************************/
+
+/**
+ * Procesa la rueda hasta el tick actual y atiende los temporizadores vencidos
+ * Se ejecuta como trabajo diferido
+ * @param arg	No se usa
+ */
+static void bsp_timer_run (void *arg)
+{
+	uint32_t ticks, slot, level;
+	bsp_timer_link_t expired;
+
+	/* Los ticks que lleguen a partir de ahora volverán a encolar el trabajo */
+	bsp_timer_work_pending = 0;
+
+	ticks = bsp_ticks ();
+
+	while ((int32_t) (ticks - bsp_timer_now) >= 0)
+	{
+		/* Con la rueda vacía no hay nada que procesar */
+		if (bsp_timer_count == 0)
+		{
+			bsp_timer_now = ticks + 1;
+			break;
+		}
+
+		slot = bsp_timer_now & BSP_TIMER_SLOT_MASK;
+
+		/* Al completar una vuelta de un nivel, repartimos la siguiente ranura
+		   del nivel superior */
+		for (level = 1; level < BSP_TIMER_LEVELS && slot == 0; level++)
+			slot = bsp_timer_cascade (level,
+					(bsp_timer_now >> (level * BSP_TIMER_SLOT_BITS)) & BSP_TIMER_SLOT_MASK);
+
+		/* Avanzamos antes de atender los temporizadores, de forma que los que
+		   se arranquen desde sus funciones no caigan en la ranura actual */
+		bsp_timer_list_move (&bsp_timer_wheel[0][bsp_timer_now & BSP_TIMER_SLOT_MASK], &expired);
+		bsp_timer_now++;
+
+		while (expired.next != &expired)
+		{
+			bsp_timer_t *timer = (bsp_timer_t *) expired.next;
+
+			bsp_timer_list_del (&timer->link);
+			bsp_timer_count--;
+
+			timer->func (timer->arg);
+		}
+	}
+}
+
+/*****************************************************************************/
+
+/**
+ * Función de tick
+ * Encola el procesado de la rueda si hay temporizadores activos
+ */
+static void bsp_timer_tick (void)
+{
+	if (bsp_timer_count == 0 || bsp_timer_work_pending)
+		return;
+
+	/* Si la cola está llena lo intentaremos en el siguiente tick */
+	if (bsp_work_post (bsp_timer_run, NULL) == 0)
+		bsp_timer_work_pending = 1;
+}
+
+/*****************************************************************************/
+
+/**
+ * Inicializa los temporizadores software
+ * Se deben inicializar después del temporizador del sistema
+ * @return		Cero en caso de éxito o -1 en caso de error.
+ * 				La condición de error se indica en la variable global errno
+ */
+int32_t bsp_timer_init (void)
+{
+	uint32_t level, slot;
+
+	for (level = 0; level < BSP_TIMER_LEVELS; level++)
+		for (slot = 0; slot < BSP_TIMER_SLOTS; slot++)
+			bsp_timer_wheel[level][slot].next = bsp_timer_wheel[level][slot].prev =
+					&bsp_timer_wheel[level][slot];
+
+	bsp_timer_now = bsp_ticks ();
+	bsp_timer_count = 0;
+	bsp_timer_work_pending = 0;
+
+	return tmr_add_tick_hook (bsp_timer_tick);
+}
+
+/*****************************************************************************/
+
+/**
+ * Arranca un temporizador, o lo rearranca si ya estaba activo
+ * La función se llama como trabajo diferido (ver bsp_run_pending), fuera del
+ * contexto de interrupción. El coste es constante. Sólo debe llamarse en modo
+ * usuario, incluidas las propias funciones de los temporizadores
+ * @param timer	Temporizador
+ * @param ticks	Ticks hasta que venza. La precisión es de un tick
+ * @param func	Función a llamar al vencer
+ * @param arg	Argumento para la función
+ * @return		Cero en caso de éxito o -1 en caso de error.
+ * 				La condición de error se indica en la variable global errno
+ */
+int32_t bsp_timer_start (bsp_timer_t *timer, uint32_t ticks, bsp_timer_func_t func, void *arg)
+{
+	if (timer == NULL || func == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+
+	bsp_timer_cancel (timer);
+
+	/* Con la rueda vacía puede haberse quedado atrás. La ponemos en hora */
+	if (bsp_timer_count == 0)
+		bsp_timer_now = bsp_ticks ();
+
+	timer->expires = bsp_ticks () + ticks;
+	timer->func = func;
+	timer->arg = arg;
+
+	bsp_timer_insert (timer);
+	bsp_timer_count++;
+
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Detiene un temporizador
+ * El coste es constante. Sólo debe llamarse en modo usuario
+ * @param timer	Temporizador
+ * @return		1 si el temporizador estaba activo o 0 si no lo estaba
+ */
+uint32_t bsp_timer_cancel (bsp_timer_t *timer)
+{
+	if (!bsp_timer_is_active (timer))
+		return 0;
+
+	bsp_timer_list_del (&timer->link);
+	bsp_timer_count--;
+
+	return 1;
+}
+
+/*****************************************************************************/
+
+/**
+ * Retorna 1 si el temporizador está activo
+ * @param timer	Temporizador
+ */
+inline uint32_t bsp_timer_is_active (bsp_timer_t *timer)
+{
+	return timer != NULL && timer->link.next != NULL;
+}
+
+/*****************************************************************************/
@@ -0,0 +1,120 @@
+/*
+ * Sistemas operativos empotrados
+ * Cola de trabajo diferido
+ */
+
+#include <errno.h>
+#include "system.h"
+#include "circular_buffer.h"
+
+/*****************************************************************************/
+
+/**
+ * Trabajo diferido
+ */
+typedef struct
+{
+	bsp_work_func_t func;
+	void *arg;
+} bsp_work_t;
+
+/*****************************************************************************/
+
+/**
+ * Cola de trabajos
+ * Como los búferes circulares, usa contadores libres y un tamaño potencia de
+ * dos. El consumidor (bsp_run_pending, en modo usuario) sólo modifica start y
+ * no necesita regiones críticas. Los productores son las ISR, que pueden
+ * anidarse, por lo que la escritura de un trabajo se hace con las IRQ
+ * deshabilitadas durante unas pocas instrucciones
+ */
+CIRCULAR_BUFFER_CHECK_SIZE (BSP_WORK_QUEUE, BSP_WORK_QUEUE_SIZE);
+
+static bsp_work_t bsp_work_queue[BSP_WORK_QUEUE_SIZE];
+static volatile uint32_t bsp_work_start = 0;
+static volatile uint32_t bsp_work_end = 0;
+
+/**
+ * Indica si bsp_run_pending se está ejecutando
+ */
+static uint32_t bsp_work_running = 0;
+
+/*****************************************************************************/
+
+/**
+ * Encola un trabajo para que se ejecute más tarde en modo usuario
+ * Está pensada para llamarse desde las ISR, que así pueden retornar enseguida
+ * en vez de ejecutar código de usuario en modo IRQ. Sólo funciona en modos
+ * privilegiados. Despierta a quien espera en bsp_poll, que ejecuta los trabajos
+ * @param func	Función a ejecutar
+ * @param arg	Argumento para la función
+ * @return		Cero en caso de éxito o -1 si la cola está llena.
+ * 				La condición de error se indica en la variable global errno
+ */
+int32_t bsp_work_post (bsp_work_func_t func, void *arg)
+{
+	uint32_t i_bit, end;
+	int32_t ret = 0;
+
+	i_bit = excep_disable_irq ();
+
+	end = bsp_work_end;
+	if (end - bsp_work_start == BSP_WORK_QUEUE_SIZE)
+	{
+		errno = EAGAIN;
+		ret = -1;
+	}
+	else
+	{
+		bsp_work_queue[end & (BSP_WORK_QUEUE_SIZE - 1)].func = func;
+		bsp_work_queue[end & (BSP_WORK_QUEUE_SIZE - 1)].arg = arg;
+
+		/* El trabajo debe estar en memoria antes de publicarlo */
+		asm volatile ("" : : : "memory");
+		bsp_work_end = end + 1;
+	}
+
+	excep_restore_irq (i_bit);
+
+	/* Quien espera en bsp_poll es quien ejecuta los trabajos */
+	if (ret == 0)
+		bsp_poll_wakeup ();
+
+	return ret;
+}
+
+/*****************************************************************************/
+
+/**
+ * Ejecuta los trabajos pendientes en el orden en que se encolaron
+ * Debe llamarse desde el bucle principal de la aplicación o cuando el sistema
+ * está ocioso. Si se llama desde un trabajo que ya se está ejecutando no hace nada
+ * @return		El número de trabajos ejecutados
+ */
+uint32_t bsp_run_pending (void)
+{
+	bsp_work_t work;
+	uint32_t start, count = 0;
+
+	if (bsp_work_running)
+		return 0;
+	bsp_work_running = 1;
+
+	while ((start = bsp_work_start) != bsp_work_end)
+	{
+		work = bsp_work_queue[start & (BSP_WORK_QUEUE_SIZE - 1)];
+
+		/* El trabajo debe leerse antes de liberar su posición */
+		asm volatile ("" : : : "memory");
+		bsp_work_start = start + 1;
+
+		work.func (work.arg);
+		count++;
+	}
+
+	bsp_work_running = 0;
+
+	return count;
+}
+
+/*****************************************************************************/
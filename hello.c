@@ -23,18 +23,12 @@
 #define s2_out gpio_pin_23
 #define s2_in gpio_pin_27
 
-// Application delay
-uint32_t const delay = 0xB0000;
+// Application delay (us)
+uint32_t const delay = 500000;
 // Leds state. Only switch on when set to 1
 uint8_t red_led = 1;
 uint8_t green_led = 2;
 
-void pause(uint32_t delay) {
-    uint32_t i;
-    // Active waiting. No sleep support
-    for (i = 0; i < delay; i++);
-}
-
 void uart_callback() {
     switch (getchar()) {
     case 'g':
@@ -94,10 +88,11 @@ int main() {
             gpio_clear_pin(RED_LED);
         }
 
-        pause(delay);
+        // Sleep. Meanwhile, the work deferred by the ISRs (the uart callback) runs
+        bsp_sleep_us(delay);
         gpio_clear_pin(RED_LED);
         gpio_clear_pin(GREEN_LED);
-        pause(delay);
+        bsp_sleep_us(delay);
     }
 
     return 0;
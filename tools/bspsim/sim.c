@@ -0,0 +1,1069 @@
+/*
+ * Sistemas operativos empotrados
+ * Simulador de periféricos del MC1322x para ejecutar el BSP en el host
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <ucontext.h>
+#include <sys/mman.h>
+#include "sim_priv.h"
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE	0x100000
+#endif
+
+/*****************************************************************************/
+
+/**
+ * Tamaño de las páginas de registros
+ */
+#define SIM_PAGE_SIZE		4096
+
+/**
+ * Bit de paso a paso (TF) del registro de flags de x86
+ */
+#define SIM_EFLAGS_TF		0x100
+
+/**
+ * Acceso a un registro de 32 o 16 bits de una página de registros
+ */
+#define SIM_REG(base, off)	(*(volatile uint32_t *) ((base) + (off)))
+#define SIM_REG16(base, off)	(*(volatile uint16_t *) ((base) + (off)))
+
+/**
+ * Tiempo simulado infinito
+ */
+#define SIM_NEVER			UINT64_MAX
+
+/*****************************************************************************/
+
+/**
+ * Desplazamientos de los registros de las uart (uart_regs_t en uart.c)
+ */
+#define UART_CON			0x00
+#define UART_STAT			0x04
+#define UART_DATA			0x08
+#define UART_RXCON			0x0C
+#define UART_TXCON			0x10
+#define UART_CTS			0x14
+#define UART_BR				0x18
+
+#define UART_CON_TXE		(1 << 0)
+#define UART_CON_RXE		(1 << 1)
+#define UART_CON_XTIM		(1 << 10)
+#define UART_CON_FCE		(1 << 12)
+#define UART_CON_MTXR		(1 << 13)
+#define UART_CON_MRXR		(1 << 14)
+
+#define UART_STAT_TOE		(1 << 3)
+#define UART_STAT_ROE		(1 << 4)
+#define UART_STAT_RUE		(1 << 5)
+#define UART_STAT_RXRDY		(1 << 6)
+#define UART_STAT_TXRDY		(1 << 7)
+
+/**
+ * Desplazamientos de los registros del ITC (itc_regs_t en itc.c)
+ */
+#define ITC_INTCNTL			0x00
+#define ITC_NIMASK			0x04
+#define ITC_INTENNUM		0x08
+#define ITC_INTDISNUM		0x0C
+#define ITC_INTENABLE		0x10
+#define ITC_INTTYPE			0x14
+#define ITC_NIVECTOR		0x28
+#define ITC_FIVECTOR		0x2C
+#define ITC_INTSRC			0x30
+#define ITC_INTFRC			0x34
+#define ITC_NIPEND			0x38
+#define ITC_FIPEND			0x3C
+
+#define ITC_NIMASK_NONE		0x1F
+
+/**
+ * Desplazamientos de los registros de escritura del GPIO (gpio_regs_t en gpio.c)
+ */
+#define GPIO_PAD_DIR0		0x00
+#define GPIO_DATA0			0x08
+#define GPIO_DATA_SET0		0x48
+#define GPIO_DATA_RESET0	0x50
+#define GPIO_PAD_DIR_SET0	0x58
+#define GPIO_PAD_DIR_RESET0	0x60
+
+/**
+ * Desplazamientos de los registros del canal 0 del TMR (tmr_regs_t en tmr.c)
+ */
+#define TMR_COMP1			0x00
+#define TMR_CNTR			0x0A
+#define TMR_CTRL			0x0C
+#define TMR_CSCTRL			0x14
+#define TMR_ENBL			0x1E
+
+#define TMR_CTRL_PCS(v)		(((v) >> 9) & 0xF)
+#define TMR_CTRL_CM(v)		(((v) >> 13) & 0x7)
+
+#define TMR_CSCTRL_TCF1		(1 << 4)
+#define TMR_CSCTRL_TCF1EN	(1 << 6)
+
+/*****************************************************************************/
+
+/**
+ * Modelo de una uart
+ */
+typedef struct
+{
+	uint32_t con;
+	uint32_t errors;					/* Bits de error de STAT */
+	uint32_t rx_level;
+	uint32_t tx_level;
+	uint32_t cts;
+	uint32_t br;
+
+	uint8_t rx_fifo[SIM_UART_FIFO_SIZE];
+	uint32_t rx_head, rx_count;
+	uint8_t tx_fifo[SIM_UART_FIFO_SIZE];
+	uint32_t tx_head, tx_count;
+
+	/* Registro de desplazamiento de transmisión */
+	uint32_t tx_busy;
+	uint8_t tx_shift;
+	uint64_t tx_done;
+
+	/* Línea de recepción */
+	uint8_t *in;
+	size_t in_len, in_pos, in_cap;
+	uint32_t rx_busy;
+	uint64_t rx_done;
+
+	sim_uart_sink_t sink;
+	void *sink_arg;
+	uint32_t loopback;
+	uint32_t overruns;
+} sim_uart_t;
+
+static sim_uart_t sim_uarts[uart_max];
+
+/**
+ * Modelo del ITC
+ */
+static struct
+{
+	uint32_t intcntl;
+	uint32_t nimask;
+	uint32_t intenable;
+	uint32_t inttype;
+	uint32_t intfrc;
+} sim_itc;
+
+/**
+ * Modelo del canal 0 del TMR
+ * Sólo se simula la cuenta ascendente de flancos del reloj del bus preescalado
+ * (PCS de 8 a 15) y el comparador 1. El contador valía cntr en el instante
+ * cntr_time y avanza una cuenta cada div ciclos mientras está habilitado
+ */
+static struct
+{
+	uint16_t cntr;
+	uint64_t cntr_time;
+	uint32_t div;						/* Cero si el contador está parado */
+	uint16_t comp1;
+	uint16_t csctrl;
+	uint64_t match;						/* Siguiente coincidencia con COMP1 */
+} sim_tmr;
+
+/*****************************************************************************/
+
+/**
+ * Página de registros simulada
+ * read prepara en la página el valor que leerá la instrucción que ha accedido
+ * al registro y write aplica los efectos laterales de lo que ha escrito
+ */
+typedef struct
+{
+	uintptr_t base;
+	uint32_t id;
+	uint32_t width;						/* Tamaño de los registros en bytes */
+	void (* read) (uint32_t id, uintptr_t base, uint32_t off, uint32_t write);
+	void (* write) (uint32_t id, uintptr_t base, uint32_t off);
+} sim_block_t;
+
+static void sim_gpio_read (uint32_t id, uintptr_t base, uint32_t off, uint32_t write);
+static void sim_gpio_write (uint32_t id, uintptr_t base, uint32_t off);
+static void sim_uart_read (uint32_t id, uintptr_t base, uint32_t off, uint32_t write);
+static void sim_uart_write (uint32_t id, uintptr_t base, uint32_t off);
+static void sim_itc_read (uint32_t id, uintptr_t base, uint32_t off, uint32_t write);
+static void sim_itc_write (uint32_t id, uintptr_t base, uint32_t off);
+static void sim_tmr_read (uint32_t id, uintptr_t base, uint32_t off, uint32_t write);
+static void sim_tmr_write (uint32_t id, uintptr_t base, uint32_t off);
+
+static const sim_block_t sim_blocks[] =
+{
+	{ (uintptr_t) GPIO_BASE, 0, 4, sim_gpio_read, sim_gpio_write },
+	{ (uintptr_t) UART1_BASE, uart_1, 4, sim_uart_read, sim_uart_write },
+	{ (uintptr_t) UART2_BASE, uart_2, 4, sim_uart_read, sim_uart_write },
+	{ (uintptr_t) ITC_BASE, 0, 4, sim_itc_read, sim_itc_write },
+	{ (uintptr_t) TMR_BASE, 0, 2, sim_tmr_read, sim_tmr_write }
+};
+
+#define SIM_NUM_BLOCKS	(sizeof (sim_blocks) / sizeof (sim_blocks[0]))
+
+/**
+ * Acceso a un registro en curso, entre el SIGSEGV y el SIGTRAP
+ */
+static const sim_block_t *sim_fault_block = NULL;
+static uint32_t sim_fault_off;
+static uint32_t sim_fault_write;
+
+/*****************************************************************************/
+
+/**
+ * Estado de la CPU y del tiempo simulados
+ */
+volatile uint32_t sim_irq_disabled = 1;
+volatile uint32_t sim_fiq_disabled = 1;
+
+static uint64_t sim_now = 0;
+static uint64_t sim_deadline = 0;
+static uint32_t sim_irqs = 0;
+
+/*****************************************************************************/
+
+/**
+ * Ciclos que tarda una uart en transmitir o recibir un carácter (10 bits),
+ * según su baudrate: CPU_FREQ * (INC + 1) / ((MOD + 1) * sobremuestreo)
+ * @param u		Modelo de la uart
+ * @return		Los ciclos, o cero si la frecuencia no está configurada
+ */
+static uint64_t sim_uart_char_cycles (sim_uart_t *u)
+{
+	uint64_t inc = (u->br >> 16) + 1, mod = (u->br & 0xFFFF) + 1;
+	uint64_t os = (u->con & UART_CON_XTIM) ? 8 : 16;
+
+	if (u->br == 0)
+		return 0;
+
+	return (10 * mod * os + inc - 1) / inc;
+}
+
+/*****************************************************************************/
+
+/**
+ * Retorna 1 si la FIFO de recepción alcanza el nivel de aviso
+ */
+static uint32_t sim_uart_rx_ready (sim_uart_t *u)
+{
+	return u->rx_count >= (u->rx_level ? u->rx_level : 1);
+}
+
+/*****************************************************************************/
+
+/**
+ * Retorna 1 si la FIFO de transmisión tiene al menos TxLevel huecos
+ */
+static uint32_t sim_uart_tx_ready (sim_uart_t *u)
+{
+	return SIM_UART_FIFO_SIZE - u->tx_count >= u->tx_level;
+}
+
+/*****************************************************************************/
+
+/**
+ * Retorna 1 si la uart admite más bytes por su línea de recepción
+ * Con control de flujo, la uart desactiva CTS cuando su FIFO de recepción
+ * alcanza CTS_Level y el otro extremo no empieza a enviar otro carácter
+ */
+static uint32_t sim_uart_cts (sim_uart_t *u)
+{
+	return !(u->con & UART_CON_FCE) || u->rx_count < u->cts;
+}
+
+/*****************************************************************************/
+
+/**
+ * Almacena un byte recibido en la FIFO de recepción
+ */
+static void sim_uart_rx_push (sim_uart_t *u, uint8_t byte)
+{
+	if (!(u->con & UART_CON_RXE))
+		return;
+
+	if (u->rx_count == SIM_UART_FIFO_SIZE)
+	{
+		u->errors |= UART_STAT_ROE;
+		u->overruns++;
+		return;
+	}
+
+	u->rx_fifo[(u->rx_head + u->rx_count++) % SIM_UART_FIFO_SIZE] = byte;
+}
+
+/*****************************************************************************/
+
+/**
+ * Arranca la transmisión o la recepción del siguiente carácter si la línea
+ * correspondiente está libre
+ */
+static void sim_uart_kick (sim_uart_t *u)
+{
+	uint64_t cycles = sim_uart_char_cycles (u);
+
+	if (cycles == 0)
+		return;
+
+	/* En bucle cerrado el otro extremo es la propia uart */
+	if (!u->tx_busy && u->tx_count && (u->con & UART_CON_TXE) &&
+		(!u->loopback || sim_uart_cts (u)))
+	{
+		u->tx_shift = u->tx_fifo[u->tx_head];
+		u->tx_head = (u->tx_head + 1) % SIM_UART_FIFO_SIZE;
+		u->tx_count--;
+		u->tx_busy = 1;
+		u->tx_done = sim_now + cycles;
+	}
+
+	if (!u->rx_busy && u->in_pos < u->in_len && sim_uart_cts (u))
+	{
+		u->rx_busy = 1;
+		u->rx_done = sim_now + cycles;
+	}
+}
+
+/*****************************************************************************/
+
+/**
+ * Retorna 1 si una uart solicita interrupción
+ */
+static uint32_t sim_uart_irq (sim_uart_t *u)
+{
+	return (sim_uart_rx_ready (u) && !(u->con & UART_CON_MRXR)) ||
+		   (sim_uart_tx_ready (u) && !(u->con & UART_CON_MTXR));
+}
+
+/*****************************************************************************/
+
+/**
+ * Valor del contador del TMR en el instante actual
+ */
+static uint16_t sim_tmr_count (void)
+{
+	if (sim_tmr.div == 0)
+		return sim_tmr.cntr;
+
+	return sim_tmr.cntr + (sim_now - sim_tmr.cntr_time) / sim_tmr.div;
+}
+
+/*****************************************************************************/
+
+/**
+ * Calcula el instante de la siguiente coincidencia del contador del TMR con
+ * COMP1, posterior al instante actual
+ */
+static void sim_tmr_schedule (void)
+{
+	uint64_t elapsed, counts;
+
+	if (sim_tmr.div == 0)
+	{
+		sim_tmr.match = SIM_NEVER;
+		return;
+	}
+
+	/* El contador es de 16 bits: coincide cada 65536 cuentas */
+	elapsed = (sim_now - sim_tmr.cntr_time) / sim_tmr.div;
+	counts = (uint16_t) (sim_tmr.comp1 - sim_tmr.cntr);
+	if (counts <= elapsed)
+		counts += ((elapsed - counts) / 0x10000 + 1) * 0x10000;
+
+	sim_tmr.match = sim_tmr.cntr_time + counts * sim_tmr.div;
+}
+
+/*****************************************************************************/
+
+/**
+ * Fuentes de interrupción activas en el ITC
+ */
+static uint32_t sim_itc_intsrc (void)
+{
+	uint32_t src = sim_itc.intfrc;
+
+	if (sim_uart_irq (&sim_uarts[uart_1]))
+		src |= 1 << itc_src_uart1;
+	if (sim_uart_irq (&sim_uarts[uart_2]))
+		src |= 1 << itc_src_uart2;
+	if ((sim_tmr.csctrl & TMR_CSCTRL_TCF1) && (sim_tmr.csctrl & TMR_CSCTRL_TCF1EN))
+		src |= 1 << itc_src_tmr;
+
+	return src;
+}
+
+/*****************************************************************************/
+
+/**
+ * Interrupciones normales pendientes, teniendo en cuenta NIMASK
+ */
+static uint32_t sim_itc_nipend (void)
+{
+	uint32_t pend = sim_itc_intsrc () & sim_itc.intenable & ~sim_itc.inttype;
+
+	/* Se enmascaran las fuentes con número menor o igual que NIMASK */
+	if (sim_itc.nimask != ITC_NIMASK_NONE)
+		pend &= ~((2u << sim_itc.nimask) - 1);
+
+	return pend;
+}
+
+/*****************************************************************************/
+
+/**
+ * Interrupciones rápidas pendientes
+ */
+static uint32_t sim_itc_fipend (void)
+{
+	return sim_itc_intsrc () & sim_itc.intenable & sim_itc.inttype;
+}
+
+/*****************************************************************************/
+
+/**
+ * Número de la fuente pendiente de más prioridad (la de número más alto)
+ */
+static uint32_t sim_itc_vector (uint32_t pend)
+{
+	uint32_t src;
+
+	for (src = itc_src_max - 1; src > 0; src--)
+		if (pend & (1 << src))
+			break;
+
+	return src;
+}
+
+/*****************************************************************************/
+
+/**
+ * Instante del siguiente evento de los periféricos
+ */
+static uint64_t sim_next_event (void)
+{
+	uint64_t next = sim_tmr.match;
+	uint32_t i;
+
+	for (i = 0; i < uart_max; i++)
+	{
+		sim_uart_t *u = &sim_uarts[i];
+
+		sim_uart_kick (u);
+		if (u->tx_busy && u->tx_done < next)
+			next = u->tx_done;
+		if (u->rx_busy && u->rx_done < next)
+			next = u->rx_done;
+	}
+
+	return next;
+}
+
+/*****************************************************************************/
+
+/**
+ * Procesa los eventos de los periféricos que vencen en el instante indicado
+ */
+static void sim_fire (uint64_t t)
+{
+	uint32_t i;
+
+	if (sim_tmr.match <= t)
+	{
+		sim_tmr.csctrl |= TMR_CSCTRL_TCF1;
+		sim_tmr_schedule ();
+	}
+
+	for (i = 0; i < uart_max; i++)
+	{
+		sim_uart_t *u = &sim_uarts[i];
+
+		if (u->tx_busy && u->tx_done <= t)
+		{
+			u->tx_busy = 0;
+			if (u->loopback)
+				sim_uart_rx_push (u, u->tx_shift);
+			if (u->sink)
+				u->sink (i, u->tx_shift, u->sink_arg);
+		}
+
+		if (u->rx_busy && u->rx_done <= t)
+		{
+			u->rx_busy = 0;
+			sim_uart_rx_push (u, u->in[u->in_pos++]);
+		}
+
+		sim_uart_kick (u);
+	}
+}
+
+/*****************************************************************************/
+
+/**
+ * Avanza el tiempo simulado hasta el instante indicado, procesando en orden
+ * los eventos de los periféricos y atendiendo las interrupciones que generan
+ */
+static void sim_run_until (uint64_t t)
+{
+	uint64_t next;
+
+	while ((next = sim_next_event ()) <= t)
+	{
+		if (next > sim_now)
+			sim_now = next;
+		sim_fire (next);
+		sim_irq_check ();
+	}
+
+	if (t > sim_now)
+		sim_now = t;
+
+	if (sim_deadline && sim_now > sim_deadline)
+	{
+		fprintf (stderr, "bspsim: simulated time limit exceeded (%llu cycles)\n",
+				(unsigned long long) sim_deadline);
+		_exit (EXIT_FAILURE);
+	}
+
+	sim_irq_check ();
+}
+
+/*****************************************************************************/
+
+/**
+ * Modelo del GPIO
+ * Los registros se almacenan en la propia página, salvo los de activación y
+ * desactivación de bits, que actúan sobre los de datos y dirección
+ */
+static void sim_gpio_read (uint32_t id, uintptr_t base, uint32_t off, uint32_t write)
+{
+	if (off >= GPIO_DATA_SET0 && off < GPIO_PAD_DIR_RESET0 + 8)
+		SIM_REG (base, off) = 0;
+}
+
+static void sim_gpio_write (uint32_t id, uintptr_t base, uint32_t off)
+{
+	uint32_t v = SIM_REG (base, off), bank = off & 4;
+
+	if (off >= GPIO_DATA_SET0 && off < GPIO_DATA_SET0 + 8)
+		SIM_REG (base, GPIO_DATA0 + bank) |= v;
+	else if (off >= GPIO_DATA_RESET0 && off < GPIO_DATA_RESET0 + 8)
+		SIM_REG (base, GPIO_DATA0 + bank) &= ~v;
+	else if (off >= GPIO_PAD_DIR_SET0 && off < GPIO_PAD_DIR_SET0 + 8)
+		SIM_REG (base, GPIO_PAD_DIR0 + bank) |= v;
+	else if (off >= GPIO_PAD_DIR_RESET0 && off < GPIO_PAD_DIR_RESET0 + 8)
+		SIM_REG (base, GPIO_PAD_DIR0 + bank) &= ~v;
+}
+
+/*****************************************************************************/
+
+/**
+ * Modelo de las uart
+ * Al leer RxCON y TxCON se obtiene la ocupación de las FIFO y al escribirlos
+ * se fijan los niveles de aviso. Leer DATA extrae un byte de la FIFO de
+ * recepción y escribirlo encola un byte en la de transmisión. Leer STAT limpia
+ * los bits de error
+ */
+static void sim_uart_read (uint32_t id, uintptr_t base, uint32_t off, uint32_t write)
+{
+	sim_uart_t *u = &sim_uarts[id];
+	uint32_t v = 0;
+
+	switch (off)
+	{
+	case UART_CON:
+		v = u->con;
+		break;
+	case UART_STAT:
+		v = u->errors |
+			(sim_uart_rx_ready (u) ? UART_STAT_RXRDY : 0) |
+			(sim_uart_tx_ready (u) ? UART_STAT_TXRDY : 0);
+		if (!write)
+			u->errors = 0;
+		break;
+	case UART_DATA:
+		if (write)
+			break;
+		if (u->rx_count == 0)
+		{
+			u->errors |= UART_STAT_RUE;
+			break;
+		}
+		v = u->rx_fifo[u->rx_head];
+		u->rx_head = (u->rx_head + 1) % SIM_UART_FIFO_SIZE;
+		u->rx_count--;
+		break;
+	case UART_RXCON:
+		v = u->rx_count;
+		break;
+	case UART_TXCON:
+		v = SIM_UART_FIFO_SIZE - u->tx_count;
+		break;
+	case UART_CTS:
+		v = u->cts;
+		break;
+	case UART_BR:
+		v = u->br;
+		break;
+	}
+
+	SIM_REG (base, off) = v;
+}
+
+static void sim_uart_write (uint32_t id, uintptr_t base, uint32_t off)
+{
+	sim_uart_t *u = &sim_uarts[id];
+	uint32_t v = SIM_REG (base, off);
+
+	switch (off)
+	{
+	case UART_CON:
+		u->con = v;
+		break;
+	case UART_DATA:
+		if (u->tx_count == SIM_UART_FIFO_SIZE)
+			u->errors |= UART_STAT_TOE;
+		else
+			u->tx_fifo[(u->tx_head + u->tx_count++) % SIM_UART_FIFO_SIZE] = v;
+		break;
+	case UART_RXCON:
+		u->rx_level = v & 0x1F;
+		break;
+	case UART_TXCON:
+		u->tx_level = v & 0x1F;
+		break;
+	case UART_CTS:
+		u->cts = v & 0x1F;
+		break;
+	case UART_BR:
+		u->br = v;
+		break;
+	}
+
+	sim_uart_kick (u);
+}
+
+/*****************************************************************************/
+
+/**
+ * Modelo del ITC
+ */
+static void sim_itc_read (uint32_t id, uintptr_t base, uint32_t off, uint32_t write)
+{
+	uint32_t v = 0;
+
+	switch (off)
+	{
+	case ITC_INTCNTL:	v = sim_itc.intcntl; break;
+	case ITC_NIMASK:	v = sim_itc.nimask; break;
+	case ITC_INTENABLE:	v = sim_itc.intenable; break;
+	case ITC_INTTYPE:	v = sim_itc.inttype; break;
+	case ITC_NIVECTOR:	v = sim_itc_vector (sim_itc_nipend ()); break;
+	case ITC_FIVECTOR:	v = sim_itc_vector (sim_itc_fipend ()); break;
+	case ITC_INTSRC:	v = sim_itc_intsrc (); break;
+	case ITC_INTFRC:	v = sim_itc.intfrc; break;
+	case ITC_NIPEND:	v = sim_itc_nipend (); break;
+	case ITC_FIPEND:	v = sim_itc_fipend (); break;
+	}
+
+	SIM_REG (base, off) = v;
+}
+
+static void sim_itc_write (uint32_t id, uintptr_t base, uint32_t off)
+{
+	uint32_t v = SIM_REG (base, off);
+
+	switch (off)
+	{
+	case ITC_INTCNTL:	sim_itc.intcntl = v; break;
+	case ITC_NIMASK:	sim_itc.nimask = v & 0x1F; break;
+	case ITC_INTENNUM:	sim_itc.intenable |= 1 << (v & 0x1F); break;
+	case ITC_INTDISNUM:	sim_itc.intenable &= ~(1 << (v & 0x1F)); break;
+	case ITC_INTENABLE:	sim_itc.intenable = v; break;
+	case ITC_INTTYPE:	sim_itc.inttype = v; break;
+	case ITC_INTFRC:	sim_itc.intfrc = v; break;
+	}
+}
+
+/*****************************************************************************/
+
+/**
+ * Modelo del TMR
+ * Los registros se almacenan en la propia página, salvo el contador, que se
+ * calcula a partir del tiempo simulado, y CSCTRL, cuyo flag TCF1 activa el
+ * comparador y sólo se puede borrar. ENBL sólo tiene efecto en el canal 0, que
+ * es el único que se simula
+ */
+static void sim_tmr_read (uint32_t id, uintptr_t base, uint32_t off, uint32_t write)
+{
+	switch (off)
+	{
+	case TMR_CNTR:		SIM_REG16 (base, off) = sim_tmr_count (); break;
+	case TMR_CSCTRL:	SIM_REG16 (base, off) = sim_tmr.csctrl; break;
+	}
+}
+
+static void sim_tmr_write (uint32_t id, uintptr_t base, uint32_t off)
+{
+	uint16_t v = SIM_REG16 (base, off);
+	uint16_t ctrl = SIM_REG16 (base, TMR_CTRL);
+
+	/* Fijamos la cuenta actual antes de cambiar la configuración, sin perder
+	   la fracción de cuenta transcurrida para que el tick no derive */
+	if (sim_tmr.div != 0)
+	{
+		uint64_t elapsed = (sim_now - sim_tmr.cntr_time) / sim_tmr.div;
+
+		sim_tmr.cntr += elapsed;
+		sim_tmr.cntr_time += elapsed * sim_tmr.div;
+	}
+	else
+		sim_tmr.cntr_time = sim_now;
+
+	switch (off)
+	{
+	case TMR_COMP1:
+		sim_tmr.comp1 = v;
+		break;
+	case TMR_CNTR:
+		sim_tmr.cntr = v;
+		sim_tmr.cntr_time = sim_now;
+		break;
+	case TMR_CSCTRL:
+		sim_tmr.csctrl = (v & ~TMR_CSCTRL_TCF1) | (v & sim_tmr.csctrl & TMR_CSCTRL_TCF1);
+		break;
+	}
+
+	if ((SIM_REG16 (base, TMR_ENBL) & 1) && TMR_CTRL_CM (ctrl) == 1 &&
+		TMR_CTRL_PCS (ctrl) >= 8)
+		sim_tmr.div = 1 << (TMR_CTRL_PCS (ctrl) - 8);
+	else
+		sim_tmr.div = 0;
+
+	sim_tmr_schedule ();
+}
+
+/*****************************************************************************/
+
+/**
+ * Manejador de SIGSEGV
+ * Si el fallo es un acceso a una página de registros, prepara el valor que
+ * leerá la instrucción, da permiso de acceso a la página y activa el paso a
+ * paso para recuperar el control tras ejecutarla
+ */
+static void sim_segv (int sig, siginfo_t *info, void *ctx)
+{
+	ucontext_t *uc = ctx;
+	uintptr_t addr = (uintptr_t) info->si_addr;
+	uint32_t i;
+
+	for (i = 0; i < SIM_NUM_BLOCKS; i++)
+		if (addr >= sim_blocks[i].base && addr < sim_blocks[i].base + SIM_PAGE_SIZE)
+			break;
+
+	if (i == SIM_NUM_BLOCKS || sim_fault_block != NULL)
+	{
+		/* Es un fallo de verdad: dejamos que termine el programa */
+		signal (SIGSEGV, SIG_DFL);
+		return;
+	}
+
+	sim_fault_block = &sim_blocks[i];
+	sim_fault_off = (addr - sim_blocks[i].base) & ~(sim_blocks[i].width - 1);
+	sim_fault_write = (uc->uc_mcontext.gregs[REG_ERR] & 2) != 0;
+
+	mprotect ((void *) sim_fault_block->base, SIM_PAGE_SIZE, PROT_READ | PROT_WRITE);
+	sim_fault_block->read (sim_fault_block->id, sim_fault_block->base,
+			sim_fault_off, sim_fault_write);
+
+	uc->uc_mcontext.gregs[REG_EFL] |= SIM_EFLAGS_TF;
+}
+
+/*****************************************************************************/
+
+/**
+ * Manejador de SIGTRAP
+ * Se ejecuta tras la instrucción que ha accedido al registro. Aplica los
+ * efectos de la escritura, vuelve a proteger la página y avanza el tiempo, lo
+ * que puede provocar interrupciones
+ */
+static void sim_trap (int sig, siginfo_t *info, void *ctx)
+{
+	ucontext_t *uc = ctx;
+	const sim_block_t *block = sim_fault_block;
+
+	uc->uc_mcontext.gregs[REG_EFL] &= ~SIM_EFLAGS_TF;
+
+	if (block == NULL)
+		return;
+
+	sim_fault_block = NULL;
+	if (sim_fault_write)
+		block->write (block->id, block->base, sim_fault_off);
+	mprotect ((void *) block->base, SIM_PAGE_SIZE, PROT_NONE);
+
+	sim_run_until (sim_now + SIM_BUS_CYCLES);
+}
+
+/*****************************************************************************/
+
+/**
+ * Inicializa el simulador
+ * Mapea las páginas de registros e instala los manejadores de señales. Debe
+ * llamarse antes de acceder a cualquier periférico
+ * @return		Cero en caso de éxito o -1 en caso de error.
+ * 				La condición de error se indica en la variable global errno
+ */
+int32_t sim_init (void)
+{
+	struct sigaction sa;
+	uint32_t i;
+
+	for (i = 0; i < SIM_NUM_BLOCKS; i++)
+	{
+		void *page = mmap ((void *) sim_blocks[i].base, SIM_PAGE_SIZE, PROT_NONE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+
+		if (page == MAP_FAILED)
+			return -1;
+		if (page != (void *) sim_blocks[i].base)
+		{
+			munmap (page, SIM_PAGE_SIZE);
+			errno = EADDRINUSE;
+			return -1;
+		}
+	}
+
+	memset (&sa, 0, sizeof (sa));
+	sigemptyset (&sa.sa_mask);
+	sa.sa_flags = SA_SIGINFO | SA_NODEFER;
+
+	/* Los manejadores de las uart se ejecutan dentro de sim_trap y acceden a
+	   su vez a los registros, así que las señales deben poder anidarse */
+	sa.sa_sigaction = sim_segv;
+	if (sigaction (SIGSEGV, &sa, NULL) < 0)
+		return -1;
+	sa.sa_sigaction = sim_trap;
+	if (sigaction (SIGTRAP, &sa, NULL) < 0)
+		return -1;
+
+	memset (sim_uarts, 0, sizeof (sim_uarts));
+	for (i = 0; i < uart_max; i++)
+		sim_uarts[i].con = UART_CON_MTXR | UART_CON_MRXR;
+
+	memset (&sim_itc, 0, sizeof (sim_itc));
+	sim_itc.nimask = ITC_NIMASK_NONE;
+
+	memset (&sim_tmr, 0, sizeof (sim_tmr));
+	sim_tmr.match = SIM_NEVER;
+
+	sim_now = 0;
+	sim_irqs = 0;
+	sim_irq_disabled = 1;
+	sim_fiq_disabled = 1;
+
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Atiende las interrupciones pendientes si la CPU simulada las admite
+ */
+void sim_irq_check (void)
+{
+	excep_handler_t fiq;
+
+	for (;;)
+	{
+		if (!sim_fiq_disabled && sim_itc_fipend ())
+		{
+			fiq = excep_get_handler (excep_fiq);
+			sim_fiq_disabled = sim_irq_disabled = 1;
+			sim_irqs++;
+			fiq ();
+			sim_fiq_disabled = 0;
+			sim_irq_disabled = 0;
+			continue;
+		}
+
+		if (sim_irq_disabled)
+			return;
+
+		if (!sim_itc_nipend ())
+			return;
+
+		sim_irq_disabled = 1;
+		sim_irqs++;
+#if EXCEP_NESTED_IRQ
+		itc_service_nested_interrupt ();
+#else
+		itc_service_normal_interrupt ();
+#endif
+		sim_irq_disabled = 0;
+	}
+}
+
+/*****************************************************************************/
+
+/**
+ * Avanza el tiempo simulado hasta el siguiente evento de los periféricos y lo
+ * procesa, como si la CPU estuviera detenida esperando una interrupción
+ */
+void sim_idle (void)
+{
+	sim_run_until (sim_next_event ());
+}
+
+/*****************************************************************************/
+
+/**
+ * Retorna el tiempo simulado en ciclos de la CPU
+ */
+uint64_t sim_cycles (void)
+{
+	return sim_now;
+}
+
+/*****************************************************************************/
+
+/**
+ * Avanza el tiempo simulado
+ * Permite contabilizar el tiempo de CPU del código que no accede a los
+ * periféricos. Durante el avance se atienden las interrupciones
+ * @param cycles	Ciclos a avanzar
+ */
+void sim_advance (uint64_t cycles)
+{
+	sim_run_until (sim_now + cycles);
+}
+
+/*****************************************************************************/
+
+/**
+ * Fija el tiempo simulado máximo
+ * Si se supera, el simulador termina el programa. Evita que un programa que
+ * espera datos que nunca llegarán se quede esperando indefinidamente
+ * @param cycles	Ciclos máximos, o cero para no poner límite
+ */
+void sim_set_deadline (uint64_t cycles)
+{
+	sim_deadline = cycles;
+}
+
+/*****************************************************************************/
+
+/**
+ * Encola bytes para que lleguen por la línea de recepción de una uart
+ * Los bytes llegan a la FIFO de recepción al ritmo que marca el baudrate. Si
+ * la FIFO está llena se pierden y se marca el error de desbordamiento (ROE)
+ * @param uart	Identificador de la uart
+ * @param data	Bytes a recibir
+ * @param len	Número de bytes
+ * @return		Cero en caso de éxito o -1 en caso de error.
+ * 				La condición de error se indica en la variable global errno
+ */
+int32_t sim_uart_inject (uart_id_t uart, const uint8_t *data, size_t len)
+{
+	sim_uart_t *u;
+
+	if (uart >= uart_max) {
+		errno = ENODEV;
+		return -1;
+	}
+	if (data == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+
+	u = &sim_uarts[uart];
+
+	/* Descartamos los bytes ya recibidos antes de hacer sitio */
+	memmove (u->in, u->in + u->in_pos, u->in_len - u->in_pos);
+	u->in_len -= u->in_pos;
+	u->in_pos = 0;
+
+	if (u->in_len + len > u->in_cap)
+	{
+		uint8_t *in = realloc (u->in, u->in_len + len);
+
+		if (in == NULL) {
+			errno = ENOMEM;
+			return -1;
+		}
+		u->in = in;
+		u->in_cap = u->in_len + len;
+	}
+
+	memcpy (u->in + u->in_len, data, len);
+	u->in_len += len;
+
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Fija la función que recibe los bytes transmitidos por una uart
+ * @param uart	Identificador de la uart
+ * @param sink	Función, o NULL para descartar los bytes
+ * @param arg	Argumento para la función
+ */
+void sim_uart_set_sink (uart_id_t uart, sim_uart_sink_t sink, void *arg)
+{
+	if (uart >= uart_max)
+		return;
+
+	sim_uarts[uart].sink = sink;
+	sim_uarts[uart].sink_arg = arg;
+}
+
+/*****************************************************************************/
+
+/**
+ * Conecta la línea de transmisión de una uart con su línea de recepción
+ * @param uart	Identificador de la uart
+ * @param on	1 para conectarlas, 0 para desconectarlas
+ */
+void sim_uart_set_loopback (uart_id_t uart, uint32_t on)
+{
+	if (uart >= uart_max)
+		return;
+
+	sim_uarts[uart].loopback = on;
+}
+
+/*****************************************************************************/
+
+/**
+ * Retorna el número de bytes perdidos por desbordamiento de la FIFO de
+ * recepción de una uart
+ * @param uart	Identificador de la uart
+ */
+uint32_t sim_uart_overruns (uart_id_t uart)
+{
+	if (uart >= uart_max)
+		return 0;
+
+	return sim_uarts[uart].overruns;
+}
+
+/*****************************************************************************/
+
+/**
+ * Retorna el número de interrupciones (IRQ y FIQ) atendidas
+ */
+uint32_t sim_irq_count (void)
+{
+	return sim_irqs;
+}
+
+/*****************************************************************************/
@@ -0,0 +1,157 @@
+/*
+ * Sistemas operativos empotrados
+ * Simulador de periféricos del MC1322x para ejecutar el BSP en el host
+ *
+ * Los drivers del BSP se compilan sin modificar para el host. Las páginas de
+ * registros del GPIO, las UART, el ITC y el TMR se mapean en sus direcciones
+ * reales (GPIO_BASE, UART1_BASE, UART2_BASE, ITC_BASE y TMR_BASE) sin permisos
+ * de acceso, de forma que cada acceso de un driver a un registro provoca un
+ * SIGSEGV. El simulador prepara el valor que leería el driver, ejecuta la
+ * instrucción paso a paso (SIGTRAP) y aplica los efectos laterales de la
+ * escritura, como lo haría el periférico: extraer un byte de la FIFO de
+ * recepción, encolarlo en la de transmisión, habilitar una fuente en el ITC,
+ * etc.
+ *
+ * El tiempo es simulado y se mide en ciclos de la CPU (CPU_FREQ). Avanza un
+ * número fijo de ciclos por acceso a un registro, cuando el programa lo indica
+ * con sim_advance y cuando la CPU espera a una interrupción. Las UART
+ * transmiten y reciben un carácter (10 bits) cada vez que transcurre el tiempo
+ * que marca su baudrate, y generan RxRdy/TxRdy según los niveles de sus FIFO de
+ * 32 bytes. Con el control de flujo activo (FCe), el otro extremo no empieza
+ * a enviar un carácter mientras la FIFO de recepción está en CTS_Level o por
+ * encima. El contador del canal 0 del TMR avanza según su preescalado y activa
+ * su fuente en el ITC al coincidir con COMP1, de modo que tmr.c genera el tick
+ * del sistema como en la placa. Las interrupciones se despachan a través del ITC con los mismos
+ * manejadores que en la placa (itc_service_nested_interrupt o
+ * itc_service_normal_interrupt, según EXCEP_NESTED_IRQ).
+ *
+ * Sólo funciona en Linux sobre x86-64. El modo FIQ de las UART no se simula
+ */
+
+#ifndef __SIM_H__
+#define __SIM_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "system.h"
+
+/*****************************************************************************/
+
+/**
+ * Ciclos que consume cada acceso a un registro de un periférico
+ */
+#define SIM_BUS_CYCLES		4
+
+/**
+ * Tamaño de las FIFO de las UART
+ */
+#define SIM_UART_FIFO_SIZE	32
+
+/*****************************************************************************/
+
+/**
+ * Prototipo para las funciones que reciben los bytes transmitidos por una uart
+ */
+typedef void (* sim_uart_sink_t) (uart_id_t uart, uint8_t byte, void *arg);
+
+/*****************************************************************************/
+
+/**
+ * Inicializa el simulador
+ * Mapea las páginas de registros e instala los manejadores de señales. Debe
+ * llamarse antes de acceder a cualquier periférico
+ * @return		Cero en caso de éxito o -1 en caso de error.
+ * 				La condición de error se indica en la variable global errno
+ */
+int32_t sim_init (void);
+
+/*****************************************************************************/
+
+/**
+ * Inicializa el BSP sobre el simulador, como bsp_init en la placa
+ * Inicializa el ITC, las UART (siempre en modo IRQ), el temporizador del
+ * sistema y los temporizadores software. La E/S estándar del host no se
+ * redirige
+ */
+void sim_bsp_init (void);
+
+/*****************************************************************************/
+
+/**
+ * Retorna el tiempo simulado en ciclos de la CPU
+ */
+uint64_t sim_cycles (void);
+
+/*****************************************************************************/
+
+/**
+ * Avanza el tiempo simulado
+ * Permite contabilizar el tiempo de CPU del código que no accede a los
+ * periféricos. Durante el avance se atienden las interrupciones
+ * @param cycles	Ciclos a avanzar
+ */
+void sim_advance (uint64_t cycles);
+
+/*****************************************************************************/
+
+/**
+ * Fija el tiempo simulado máximo
+ * Si se supera, el simulador termina el programa. Evita que un programa que
+ * espera datos que nunca llegarán se quede esperando indefinidamente
+ * @param cycles	Ciclos máximos, o cero para no poner límite
+ */
+void sim_set_deadline (uint64_t cycles);
+
+/*****************************************************************************/
+
+/**
+ * Encola bytes para que lleguen por la línea de recepción de una uart
+ * Los bytes llegan a la FIFO de recepción al ritmo que marca el baudrate. Si
+ * la FIFO está llena se pierden y se marca el error de desbordamiento (ROE),
+ * salvo que la uart tenga activado el control de flujo
+ * @param uart	Identificador de la uart
+ * @param data	Bytes a recibir
+ * @param len	Número de bytes
+ * @return		Cero en caso de éxito o -1 en caso de error.
+ * 				La condición de error se indica en la variable global errno
+ */
+int32_t sim_uart_inject (uart_id_t uart, const uint8_t *data, size_t len);
+
+/*****************************************************************************/
+
+/**
+ * Fija la función que recibe los bytes transmitidos por una uart
+ * @param uart	Identificador de la uart
+ * @param sink	Función, o NULL para descartar los bytes
+ * @param arg	Argumento para la función
+ */
+void sim_uart_set_sink (uart_id_t uart, sim_uart_sink_t sink, void *arg);
+
+/*****************************************************************************/
+
+/**
+ * Conecta la línea de transmisión de una uart con su línea de recepción
+ * @param uart	Identificador de la uart
+ * @param on	1 para conectarlas, 0 para desconectarlas
+ */
+void sim_uart_set_loopback (uart_id_t uart, uint32_t on);
+
+/*****************************************************************************/
+
+/**
+ * Retorna el número de bytes perdidos por desbordamiento de la FIFO de
+ * recepción de una uart
+ * @param uart	Identificador de la uart
+ */
+uint32_t sim_uart_overruns (uart_id_t uart);
+
+/*****************************************************************************/
+
+/**
+ * Retorna el número de interrupciones (IRQ y FIQ) atendidas
+ */
+uint32_t sim_irq_count (void);
+
+/*****************************************************************************/
+
+#endif /* __SIM_H__ */
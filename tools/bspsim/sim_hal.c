@@ -0,0 +1,185 @@
+/*
+ * Sistemas operativos empotrados
+ * Simulador de periféricos del MC1322x: sustitutos en el host de las partes
+ * del BSP que dependen de la CPU (excep.c, uart_fiq.s) o de periféricos que
+ * no se simulan (crm.c)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "sim_priv.h"
+
+/*****************************************************************************/
+
+/**
+ * Tabla de manejadores de excepción
+ */
+static excep_handler_t sim_excep_handlers[excep_max];
+
+/*****************************************************************************/
+
+/**
+ * Sustitutos de excep.c
+ * Los bits I y F de la CPU se simulan con sim_irq_disabled y sim_fiq_disabled.
+ * Al habilitar las interrupciones se atienden las que estén pendientes
+ */
+void excep_init ()
+{
+}
+
+inline uint32_t excep_disable_ints ()
+{
+	uint32_t if_bits = (sim_irq_disabled << 1) | sim_fiq_disabled;
+
+	sim_irq_disabled = sim_fiq_disabled = 1;
+
+	return if_bits;
+}
+
+inline uint32_t excep_disable_irq ()
+{
+	uint32_t i_bit = sim_irq_disabled;
+
+	sim_irq_disabled = 1;
+
+	return i_bit;
+}
+
+inline uint32_t excep_disable_fiq ()
+{
+	uint32_t f_bit = sim_fiq_disabled;
+
+	sim_fiq_disabled = 1;
+
+	return f_bit;
+}
+
+inline void excep_restore_ints (uint32_t if_bits)
+{
+	sim_irq_disabled = (if_bits >> 1) & 1;
+	sim_fiq_disabled = if_bits & 1;
+	sim_irq_check ();
+}
+
+inline void excep_restore_irq (uint32_t i_bit)
+{
+	sim_irq_disabled = i_bit & 1;
+	sim_irq_check ();
+}
+
+inline void excep_restore_fiq (uint32_t f_bit)
+{
+	sim_fiq_disabled = f_bit & 1;
+	sim_irq_check ();
+}
+
+inline uint32_t excep_critical_enter (void)
+{
+	return excep_disable_ints ();
+}
+
+inline void excep_critical_exit (uint32_t state)
+{
+	excep_restore_ints (state);
+}
+
+inline uint32_t excep_irq_enabled (void)
+{
+	return !sim_irq_disabled;
+}
+
+inline void excep_set_handler (excep_t excep, excep_handler_t handler)
+{
+	sim_excep_handlers[excep] = handler;
+}
+
+inline excep_handler_t excep_get_handler (excep_t excep)
+{
+	return sim_excep_handlers[excep];
+}
+
+/*****************************************************************************/
+
+/**
+ * Sustituto del manejador FIQ de las uart (uart_fiq.s), que no se simula
+ */
+void uart_fiq_handler (void)
+{
+	fprintf (stderr, "bspsim: the uart FIQ mode is not simulated\n");
+	abort ();
+}
+
+/*****************************************************************************/
+
+/**
+ * Sustitutos de libc.c
+ * La biblioteca de C del host no es newlib, así que no hay contextos que
+ * cambiar. Sólo se lleva la cuenta del anidamiento de las isr
+ */
+static uint32_t sim_isr_depth = 0;
+
+void bsp_isr_reent_enter (void)
+{
+	sim_isr_depth++;
+}
+
+void bsp_isr_reent_exit (void)
+{
+	sim_isr_depth--;
+}
+
+uint32_t bsp_in_isr (void)
+{
+	return sim_isr_depth != 0;
+}
+
+uint32_t bsp_isr_reent_overflow (void)
+{
+	return sim_isr_depth > BSP_ISR_REENT_LEVELS;
+}
+
+/*****************************************************************************/
+
+/**
+ * Sustitutos de crm.c
+ * Esperar a una interrupción hace avanzar el tiempo simulado
+ */
+void crm_init (void)
+{
+}
+
+inline void crm_wait_for_interrupt (void)
+{
+	uint32_t irqs = sim_irq_count ();
+
+	/* Con las IRQ deshabilitadas la CPU despierta, pero no las atiende */
+	do
+		sim_idle ();
+	while (sim_irq_count () == irqs && !sim_irq_disabled);
+}
+
+
+/*****************************************************************************/
+
+/**
+ * Inicializa el BSP sobre el simulador, como bsp_init en la placa
+ * Inicializa el ITC, las UART (siempre en modo IRQ), el temporizador del
+ * sistema y los temporizadores software. La E/S estándar del host no se
+ * redirige
+ */
+void sim_bsp_init (void)
+{
+	itc_init ();
+
+	uart_init (UART1_ID, UART1_BAUDRATE, UART1_NAME, uart_rx_irq);
+	uart_init (UART2_ID, UART2_BAUDRATE, UART2_NAME, uart_rx_irq);
+
+	tmr_init (BSP_TICK_HZ, TMR_NAME);
+
+	bsp_timer_init ();
+
+	/* Como tras el arranque en la placa, la CPU admite interrupciones */
+	excep_restore_ints (0);
+}
+
+/*****************************************************************************/
@@ -0,0 +1,65 @@
+/*
+ * Sistemas operativos empotrados
+ * Ejemplo de uso del simulador: envía un bloque de datos por la uart2 con su
+ * transmisión conectada a su recepción, lo recibe con el driver y comprueba
+ * que llega intacto
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sim.h"
+
+#define LOOPBACK_BYTES	4096
+
+static char tx_data[LOOPBACK_BYTES];
+static char rx_data[LOOPBACK_BYTES];
+
+int main (void)
+{
+	size_t sent = 0, received = 0;
+	ssize_t n;
+	uint64_t start;
+	uint32_t i;
+
+	if (sim_init () < 0) {
+		perror ("sim_init");
+		return EXIT_FAILURE;
+	}
+	sim_bsp_init ();
+
+	/* Un segundo simulado es más que suficiente a 115200 baudios */
+	sim_set_deadline (2 * (uint64_t) CPU_FREQ);
+	sim_uart_set_loopback (uart_2, 1);
+
+	for (i = 0; i < LOOPBACK_BYTES; i++)
+		tx_data[i] = rand ();
+
+	start = sim_cycles ();
+	while (received < LOOPBACK_BYTES)
+	{
+		if (sent < LOOPBACK_BYTES) {
+			n = uart_send (uart_2, tx_data + sent, LOOPBACK_BYTES - sent);
+			if (n > 0)
+				sent += n;
+		}
+
+		n = uart_receive (uart_2, rx_data + received, LOOPBACK_BYTES - received);
+		if (n > 0)
+			received += n;
+		else
+			crm_wait_for_interrupt ();
+	}
+
+	if (memcmp (tx_data, rx_data, LOOPBACK_BYTES) != 0) {
+		fprintf (stderr, "loopback data mismatch\n");
+		return EXIT_FAILURE;
+	}
+
+	printf ("%d bytes in %llu cycles (%llu bytes/s), %u interrupts, %u overruns\n",
+			LOOPBACK_BYTES, (unsigned long long) (sim_cycles () - start),
+			(unsigned long long) LOOPBACK_BYTES * CPU_FREQ / (sim_cycles () - start),
+			sim_irq_count (), sim_uart_overruns (uart_2));
+
+	return EXIT_SUCCESS;
+}
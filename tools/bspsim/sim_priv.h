@@ -0,0 +1,37 @@
+/*
+ * Sistemas operativos empotrados
+ * Simulador de periféricos del MC1322x: interfaz entre el modelo de los
+ * periféricos (sim.c) y los sustitutos del HAL (sim_hal.c)
+ */
+
+#ifndef __SIM_PRIV_H__
+#define __SIM_PRIV_H__
+
+#include "sim.h"
+
+/*****************************************************************************/
+
+/**
+ * Estado de los bits I y F simulados de la CPU
+ */
+extern volatile uint32_t sim_irq_disabled;
+extern volatile uint32_t sim_fiq_disabled;
+
+/*****************************************************************************/
+
+/**
+ * Atiende las interrupciones pendientes si la CPU simulada las admite
+ */
+void sim_irq_check (void);
+
+/*****************************************************************************/
+
+/**
+ * Avanza el tiempo simulado hasta el siguiente evento de los periféricos y lo
+ * procesa, como si la CPU estuviera detenida esperando una interrupción
+ */
+void sim_idle (void);
+
+/*****************************************************************************/
+
+#endif /* __SIM_PRIV_H__ */